@@ -0,0 +1,295 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+// wherever style.h and style.cpp are stored in
+#include "headless.h"
+#include "pool.h"
+#include "ecs.h"
+
+
+// Times the style.h primitives across a sweep of sizes. Link it with headless.cpp,
+// which is the sink: each op is drawn and presented, the bytes it sends are counted
+// by the headless terminal and the time spent parsing them is left out.
+//     ./a.out          a table
+//     ./a.out --csv    primitive,size,ns_per_op,bytes_per_op,allocs_per_op
+
+
+// every replaceable operator new counts through Allocate, plain or array, aligned or not;
+// the nothrow ones call these, and everything is given back by free
+long long allocations = 0;
+
+static void *Allocate(std::size_t size, std::size_t align = alignof(std::max_align_t))
+{
+    allocations++;
+    size = size ? size : 1;
+
+    void *memory = (align <= alignof(std::max_align_t)) ? std::malloc(size)
+                                                         : std::aligned_alloc(align, (size + align - 1) / align * align);
+    if (memory)
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size) { return Allocate(size); }
+void *operator new[](std::size_t size) { return Allocate(size); }
+void *operator new(std::size_t size, std::align_val_t align) { return Allocate(size, (std::size_t) align); }
+void *operator new[](std::size_t size, std::align_val_t align) { return Allocate(size, (std::size_t) align); }
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void *memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+
+// CanvasDraw strings as MakeTank in poopdye.cpp draws them
+const int TANK_W = 8;
+char TANK_ROWS[3][32];
+
+bool csv = false;
+
+
+// runs body in batches until it has taken a while, then prints the per op figures;
+// without present the frame isn't sent, to time only what body does to the back buffer
+template <typename Body>
+void Measure(const char *primitive, const std::string& size, Body body, bool present = true)
+{
+    const long long MIN_NANOS = 50000000;
+
+    long long reps = 0, nanos = 0;
+    long long bytes = Headless::Term().bytes, parse = Headless::parseNanos, allocs = allocations;
+
+    for (long long batch = 1; nanos < MIN_NANOS; batch *= 2)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for (long long i = 0; i < batch; i++)
+        {
+            body();
+
+            if (present)
+                Screen::Present();
+        }
+
+        nanos += std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count();
+        reps += batch;
+    }
+
+    double nsPerOp = double(nanos - (Headless::parseNanos - parse)) / reps;
+    double bytesPerOp = double(Headless::Term().bytes - bytes) / reps;
+    double allocsPerOp = double(allocations - allocs) / reps;
+
+    if (csv)
+        std::cout << primitive << ',' << size << ',' << nsPerOp << ',' << bytesPerOp << ',' << allocsPerOp << '\n';
+    else
+    {
+        char line[128];
+        snprintf(line, sizeof line, "%-24s %-12s %12.1f ns %10.1f B %8.2f allocs\n",
+                 primitive, size.c_str(), nsPerOp, bytesPerOp, allocsPerOp);
+        std::cout << line;
+    }
+}
+
+
+std::string Size(int width, int height = 1)
+{
+    return std::to_string(width) + "x" + std::to_string(height);
+}
+
+
+int main(int argc, char *argv[])
+{
+    csv = argc > 1 && std::string(argv[1]) == "--csv";
+
+    if (csv)
+        std::cout << "primitive,size,ns_per_op,bytes_per_op,allocs_per_op\n";
+
+    Screen::Paint("BLACK");
+
+    // the points of each case below, released when it is done
+    Arena scene;
+
+    // a point hopping between two cells
+    {
+        Point point({ 10, 10 }, "WHITE");
+        Coord hops[] = { { 10, 10 }, { 10, 11 } };
+        int hop = 0;
+
+        Measure("Point::MoveTo", Size(1), [&]() { point.MoveTo(hops[hop ^= 1]); });
+        point.Clear();
+    }
+
+    // lines, blocks and paints redrawn in alternating colors so each op has something to send
+    ColorId shades[] = { Palette::RED, Palette::BLUE };
+    int shade = 0;
+
+    for (int length : { 1, 10, 100, Screen::WIDTH })
+    {
+        HorzLine line("-=", length, { 1, 1 }, "WHITE");
+        Measure("HorzLine::Draw", Size(length), [&]() { line.thisState.bgColor = shades[shade ^= 1]; line.Draw(); });
+    }
+
+    for (int length : { 1, 10, Screen::HEIGHT })
+    {
+        VertLine line("|", length, { 1, 1 }, "WHITE");
+        Measure("VertLine::Draw", Size(1, length), [&]() { line.thisState.bgColor = shades[shade ^= 1]; line.Draw(); });
+    }
+
+    const Coord BLOCKS[] = { { 1, 1 }, { 5, 10 }, { 20, 40 }, { Screen::HEIGHT, Screen::WIDTH } };
+
+    for (Coord size : BLOCKS)
+    {
+        Block block(" ", size.COL, size.ROW, { 1, 1 }, "GRAY");
+        Measure("Block::Draw", Size(size.COL, size.ROW), [&]() { block.thisState.bgColor = shades[shade ^= 1]; block.Draw(); });
+    }
+
+    // shrinking by a row and a column, then growing back
+    for (Coord size : BLOCKS)
+    {
+        if (size.ROW == 1)
+            continue;
+
+        Block block(" ", size.COL, size.ROW, { 1, 1 }, "GRAY");
+        int step = 1;
+
+        Measure("Block::Reframe", Size(size.COL, size.ROW), [&]() { step = -step; block.Reframe({ step, step }); });
+    }
+
+    // stepping down a row and back up, as the poop moves
+    for (Coord size : BLOCKS)
+    {
+        if (size.ROW == Screen::HEIGHT)
+            continue;
+
+        Block block(" ", size.COL, size.ROW, { 1, 1 }, "GRAY");
+        int step = 1;
+
+        Measure("Block::MoveBy", Size(size.COL, size.ROW), [&]() { step = -step; block.MoveBy({ -step, 0 }); });
+    }
+
+    // a query point just below the block, as the boulder is tested against FISH_TOP
+    for (Coord size : BLOCKS)
+    {
+        Block block(" ", size.COL, size.ROW, { 1, 1 }, "GRAY");
+        Coord below = { size.ROW + 1, 1 + size.COL / 2 };
+
+        Measure("Block::Collides", Size(size.COL, size.ROW), [&]() { block.Collides(below, "horz"); });
+    }
+
+    // two fish-shaped outlines sharing a column, point by point and by mask
+    {
+        std::vector<Figure*> outlines[2];
+
+        for (int fish = 0; fish < 2; fish++)
+            for (int row = 0; row < 2; row++)
+                for (int col = 0; col < 9; col++)
+                    outlines[fish].push_back(scene.New<Point>(Coord(30 + row, 10 + 8 * fish + col), "BATHROOM", "", '-'));
+
+        Group left(outlines[0]), right(outlines[1]);
+
+        Measure("Group::Collides", "9x2", [&]() { left.Collides(right, 0); });
+        Measure("Group::Overlaps", "9x2", [&]() { left.Overlaps(right); });
+        scene.Release();
+    }
+
+    // a fish cell by cell and as a sprite, flashed as a hit does and swimming
+    {
+        PackedGroup packed("BATHROOM");
+
+        for (int row = 0; row < 2; row++)
+            for (int col = 0; col < 9; col++)
+                packed.Add(Coord(30 + row, 10 + col), (col == 0 || col == 8) ? '+' : '-');
+
+        Sprite sprite({ "+-------+", "+---.---+" }, { 33, 10 }, "BATHROOM");
+        bool flash = false;
+        int step = 1;
+
+        Measure("PackedGroup::ChangeColor", "9x2", [&]() { flash = !flash; packed.ChangeColor(flash ? "PINK" : "BATHROOM"); });
+        Measure("Sprite::ChangeColor", "9x2", [&]() { flash = !flash; sprite.ChangeColor(flash ? "PINK" : "BATHROOM"); });
+        Measure("PackedGroup::MoveBy", "9x2", [&]() { step = -step; packed.MoveBy({ 0, -step }); });
+        Measure("Sprite::MoveBy", "9x2", [&]() { step = -step; sprite.MoveBy({ 0, -step }); });
+
+        packed.Clear();
+        sprite.Clear();
+    }
+
+    for (int count : { 10, 100, 1000, 10000 })
+    {
+        std::vector<Figure*> points;
+
+        for (int i = 0; i < count; i++)
+            points.push_back(scene.New<Point>(Coord(1 + i / (Screen::WIDTH - 1) % Screen::HEIGHT, 1 + i % (Screen::WIDTH - 1)), "GREEN", "", 'o'));
+
+        Group group(points);
+        int step = 1;
+
+        Measure("Group::MoveBy", std::to_string(count), [&]() { step = -step; group.MoveBy({ 0, -step }); });
+
+        group.Clear();
+        scene.Release();
+
+        PackedGroup packed("GREEN");
+
+        for (int i = 0; i < count; i++)
+            packed.Add({ 1 + i / (Screen::WIDTH - 1) % Screen::HEIGHT, 1 + i % (Screen::WIDTH - 1) }, 'o');
+
+        Measure("PackedGroup::MoveBy", std::to_string(count), [&]() { step = -step; packed.MoveBy({ 0, -step }); });
+        packed.Clear();
+
+        // as many entities, a column apart as each point moves on its own, turned around every op
+        World world;
+
+        for (int i = 0; i < count; i++)
+        {
+            Entity entity = world.Create();
+            Coord at = { 1 + i / (Screen::WIDTH / 2) % Screen::HEIGHT, 1 + 2 * (i % (Screen::WIDTH / 2)) };
+
+            world.position.Add(entity, at);
+            world.velocity.Add(entity, { 0, 1 });
+            world.sprite.Add(entity, scene.New<Point>(at, "GREEN", "", 'o'));
+        }
+
+        Measure("World::Move+Render", std::to_string(count), [&]()
+        {
+            for (int i = 0; i < count; i++)
+                world.velocity[i].COL = -world.velocity[i].COL;
+
+            world.Move();
+            world.Render();
+        });
+
+        for (int i = 0; i < count; i++)
+            world.sprite[i]->Clear();
+        scene.Release();
+    }
+
+    Measure("Screen::Paint", Size(Screen::WIDTH, Screen::HEIGHT), [&]() { Screen::Paint(shades[shade ^= 1]); });
+
+    // CanvasDraw compiling the string on every call, replaying the cached program,
+    // and the compile-time form that only fills in the %d values; not presented, as
+    // sending the frame would take longer than any of them
+    Fmt(TANK_ROWS[0], sizeof TANK_ROWS[0], "' ' '_'_%d ' '", TANK_W - 2);
+    Fmt(TANK_ROWS[1], sizeof TANK_ROWS[1], "d l%d '|' ' '_%d '|'", TANK_W, TANK_W - 2);
+    Fmt(TANK_ROWS[2], sizeof TANK_ROWS[2], "d l%d '*' '-'_%d '*'", TANK_W, TANK_W - 2);
+
+    void (*lowered[])() = {
+        []() { Screen::AtCoord({ 2, 3 }); CanvasDraw<"' ' '_'_%d ' '">(TANK_W - 2); },
+        []() { Screen::AtCoord({ 2, 3 }); CanvasDraw<"d l%d '|' ' '_%d '|'">(TANK_W, TANK_W - 2); },
+        []() { Screen::AtCoord({ 2, 3 }); CanvasDraw<"d l%d '*' '-'_%d '*'">(TANK_W, TANK_W - 2); }
+    };
+
+    for (int i = 0; i < 3; i++)
+    {
+        const char *cmd = TANK_ROWS[i];
+        std::string row = "tank" + std::to_string(i);
+
+        Measure("CanvasDraw parsed", row, [&]() { Screen::AtCoord({ 2, 3 }); CanvasProgram(cmd).Run(); }, false);
+        Measure("CanvasDraw cached", row, [&]() { Screen::AtCoord({ 2, 3 }); CanvasProgram::Compiled(cmd).Run(); }, false);
+        Measure("CanvasDraw literal", row, lowered[i], false);
+    }
+}
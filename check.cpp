@@ -0,0 +1,403 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+// wherever style.h and style.cpp are stored in
+#include "headless.h"
+
+
+// Checks the faster paths of style.h against the plain code they stand for, on random
+// figures, and replays headless game sessions against the screens kept in golden/.
+// Link it with headless.cpp, and build the games headless next to it to replay them:
+//     g++ -std=c++20 -O2 style.cpp headless.cpp poopdye.cpp -o poopdye
+//     g++ -std=c++20 -O2 style.cpp headless.cpp ping_pong.cpp -o ping_pong
+//     ./a.out            every check, exits with 1 if any of them differs
+//     ./a.out --golden   writes the screens in golden/ anew, after a change meant to alter them
+// The screens are snapshots taken while the game is on, then the one it leaves at exit,
+// each with its glyphs, foregrounds and backgrounds.
+
+
+int failed = 0;
+
+
+// prints how many of runs differed from what they were checked against
+void Report(const std::string& check, int differ, int runs)
+{
+    std::cout << check << ": " << differ << " of " << runs << " differ\n";
+
+    if (differ)
+        failed++;
+}
+
+
+int Random(int st, int end)
+{
+    return st + std::rand() % (end - st + 1);
+}
+
+
+
+// COLLISIONS
+
+// Collides as it was before it was answered from the bounding box: a walk over
+// Perimeter() for the cells within dist of the point's row, column or both
+int WalkCollides(const Figure& figure, const Coord& QPoint, const std::string& lineType, int dist)
+{
+    int res = 0;
+    bool notFound[] = { true, true, true, true };  //UP, DOWN, RIGHT, LEFT
+
+    if (lineType == "horz" || lineType == "all")
+    {
+        for (Coord thisPt : figure.Perimeter())
+        {
+            int diff = thisPt.ROW - QPoint.ROW;
+
+            if (std::abs(diff) > dist)
+                continue;
+
+            if (lineType != "all")
+                return (diff > 0) ? Dir::DOWN : Dir::UP;
+
+            if (diff < 0 && notFound[0])
+            {
+                res += Dir::UP;
+                notFound[0] = false;
+            }
+            else if (diff > 0 && notFound[1])
+            {
+                res += Dir::DOWN;
+                notFound[1] = false;
+            }
+        }
+    }
+
+    if (lineType == "vert" || lineType == "all")
+    {
+        for (Coord thisPt : figure.Perimeter())
+        {
+            int diff = thisPt.COL - QPoint.COL;
+
+            if (std::abs(diff) > dist)
+                continue;
+
+            if (lineType != "all")
+                return (diff > 0) ? Dir::RIGHT : Dir::LEFT;
+
+            if (diff > 0 && notFound[2])
+            {
+                res += Dir::RIGHT;
+                notFound[2] = false;
+            }
+            else if (diff < 0 && notFound[3])
+            {
+                res += Dir::LEFT;
+                notFound[3] = false;
+            }
+        }
+    }
+
+    return res;
+}
+
+
+// points, lines, blocks and packed groups against points around them
+void CheckCollides(int runs)
+{
+    const char *LINE_TYPES[] = { "horz", "vert", "all" };
+    int differ = 0;
+
+    for (int run = 0; run < runs; run++)
+    {
+        Coord at = { Random(5, 25), Random(5, 45) };
+        int width = Random(1, 6), height = Random(1, 6);
+
+        auto check = [&](Figure& figure)
+        {
+            Coord QPoint = at + Coord(Random(-8, 8), Random(-8, 8));
+            const char *lineType = LINE_TYPES[Random(0, 2)];
+            int dist = Random(0, 3);
+
+            differ += figure.Collides(QPoint, lineType, dist) != WalkCollides(figure, QPoint, lineType, dist);
+            figure.Clear();
+        };
+
+        switch (Random(0, 4))
+        {
+            case 0: { Point point(at); check(point); break; }
+            case 1: { HorzLine line("-", width, at); check(line); break; }
+            case 2: { VertLine line("|", height, at); check(line); break; }
+            case 3: { Block block(" ", width, height, at); check(block); break; }
+
+            default:
+            {
+                PackedGroup group("GREEN");
+
+                for (int n = Random(1, 12); n--; )
+                    group.Add(at + Coord(Random(0, height), Random(0, width)), '+');
+
+                check(group);
+            }
+        }
+    }
+
+    Report("Collides vs a walk of Perimeter()", differ, runs);
+}
+
+
+
+// MOVES
+
+// what every layer and the back buffer hold, to run a move twice from the same screen
+class Snapshot
+{
+    public:
+        std::vector<Cell> backBuff, layers[Layer::COUNT];
+        int topLayer;
+
+        Snapshot()
+        {
+            backBuff = Screen::backBuff;
+            std::copy_n(Screen::layers, Layer::COUNT, layers);
+            topLayer = Screen::topLayer;
+        }
+
+        void Restore() const
+        {
+            Screen::backBuff = backBuff;
+            std::copy_n(layers, Layer::COUNT, Screen::layers);
+            Screen::topLayer = topLayer;
+        }
+
+        bool operator==(const Snapshot& other) const
+        {
+            return backBuff == other.backBuff && std::equal(layers, layers + Layer::COUNT, other.layers);
+        }
+};
+
+
+// random scenery under the actors and a few HUD cells over them, for a move to uncover and stay under
+void Scatter()
+{
+    for (std::vector<Cell>& layer : Screen::layers)
+        std::fill(layer.begin(), layer.end(), Cell('\0'));
+
+    for (int i = 0; i < Screen::HEIGHT * Screen::WIDTH; i++)
+    {
+        Cell& scenery = Screen::layers[Layer::SCENERY][i];
+        Cell& hud = Screen::layers[Layer::HUD][i];
+
+        if (Random(0, 2))
+            scenery = Cell('a' + Random(0, 25), Random(1, 3), Random(1, 3));
+
+        if (Random(0, 49) == 0)
+            hud = Cell('H', Palette::WHITE, Random(1, 3));
+
+        Screen::backBuff[i] = !hud.IsEmpty() ? hud : !scenery.IsEmpty() ? scenery : Cell(' ', Palette::NONE, Screen::SCREEN_BG);
+    }
+
+    Screen::topLayer = Layer::HUD;
+}
+
+
+// Moves each figure by diff the way it does it, clearing and drawing only what changes,
+// and the plain way, clearing all of it and drawing all of it again; reference does the
+// latter and undo puts the figure back where it was before the move.
+template <typename Reference, typename Undo>
+bool MovesAsRedrawn(Figure& figure, const Coord& diff, Reference reference, Undo undo)
+{
+    Snapshot before;
+
+    reference();
+    Snapshot redrawn;
+
+    before.Restore();
+    undo();
+    figure.MoveBy(diff);
+
+    return Snapshot() == redrawn;
+}
+
+
+// blocks, groups of points, packed groups and sprites moved by a few cells, or anywhere,
+// over scenery, some of them partly off the screen
+void CheckMoves(int runs)
+{
+    const char *PATTERNS[] = { " ", "~ ", "abc", "-=+*" };
+    int differ = 0;
+
+    auto somewhere = [&]() { return Coord(Random(-3, Screen::HEIGHT + 1), Random(-10, Screen::WIDTH + 2)); };
+
+    for (int run = 0; run < runs; run++)
+    {
+        Scatter();
+        Screen::SetLayer(Layer::ACTORS);
+
+        Coord at = somewhere();
+        Coord diff = { Random(-3, 3), Random(-4, 4) };
+
+        if (Random(0, 4) == 0)
+            diff = somewhere() - at;
+
+        switch (Random(0, 3))
+        {
+            case 0:
+            {
+                Block block(PATTERNS[Random(0, 3)], Random(1, 20), Random(1, 10), at, "GRAY", "RED");
+
+                differ += !MovesAsRedrawn(block, diff,
+                    [&]() { block.Clear(); block.thisState.coord += diff; block.Draw(); },
+                    [&]() { block.thisState.coord -= diff; });
+                break;
+            }
+
+            case 1:
+            {
+                std::vector<Point> points;
+                std::vector<Figure*> elms;
+
+                for (int n = Random(1, 20); n--; )
+                    points.emplace_back(at + Coord(Random(0, 3), Random(0, 9)), "GREEN", "", "+-.*"[Random(0, 3)]);
+
+                for (Point& point : points)
+                    elms.push_back(&point);
+
+                Group group(elms, 0);
+                Mask scratch;
+                group.GetMask(scratch);
+
+                differ += !MovesAsRedrawn(group, diff,
+                    [&]() { group.Clear(); for (Point& point : points) { point.thisState.coord += diff; point.Draw(); } },
+                    [&]() { for (Point& point : points) point.thisState.coord -= diff; });
+                break;
+            }
+
+            case 2:
+            {
+                PackedGroup group("GREEN");
+
+                for (int n = Random(1, 20); n--; )
+                    group.Add(at + Coord(Random(0, 3), Random(0, 9)), "+-.*"[Random(0, 3)]);
+
+                Mask scratch;
+                group.GetMask(scratch);
+
+                differ += !MovesAsRedrawn(group, diff,
+                    [&]() { group.Clear(); group.Translate(diff); group.Draw(); },
+                    [&]() { group.Translate(Coord(0, 0) - diff); });
+                break;
+            }
+
+            default:
+            {
+                std::vector<std::string> picture(Random(1, 5));
+
+                for (std::string& row : picture)
+                    for (int n = Random(1, 12); n--; )
+                        row += Random(0, 3) ? "+-.*"[Random(0, 3)] : ' ';
+
+                Sprite sprite(picture, at, "PINK");
+
+                differ += !MovesAsRedrawn(sprite, diff,
+                    [&]() { sprite.Clear(); sprite.thisState.coord += diff; sprite.Draw(); },
+                    [&]() { sprite.thisState.coord -= diff; });
+            }
+        }
+    }
+
+    Report("MoveBy vs clearing and drawing again", differ, runs);
+}
+
+
+
+// HEADLESS REPLAYS
+
+// a fixed session of a game built headless, its screens kept in golden/<game>.txt;
+// keys takes the snapshots with ms:DUMP
+class Replay
+{
+    public:
+        const char *game;
+        const char *size;
+        std::string keys;
+        const char *env = "";
+};
+
+
+std::string ReadAll(const std::string& path)
+{
+    std::ifstream file(path);
+    std::stringstream all;
+    all << file.rdbuf();
+    return file ? all.str() : std::string();
+}
+
+
+void CheckReplay(const Replay& replay, bool golden)
+{
+    std::string dump = std::string(replay.game) + ".dump";
+    std::string goldenPath = std::string("golden/") + replay.game + ".txt";
+
+    std::remove(dump.c_str());
+
+    std::string command = std::string("HEADLESS_SIZE=") + replay.size + " HEADLESS_KEYS=" + replay.keys +
+                          " HEADLESS_DUMP=" + dump + " " + replay.env + " ./" + replay.game + " >/dev/null 2>&1";
+    std::system(command.c_str());
+
+    std::string screen = ReadAll(dump);
+    std::remove(dump.c_str());
+
+    if (screen.empty())
+    {
+        std::cout << replay.game << ": no screen, is it built headless here?\n";
+        failed++;
+        return;
+    }
+
+    if (golden)
+    {
+        std::ofstream(goldenPath) << screen;
+        std::cout << replay.game << ": written to " << goldenPath << "\n";
+        return;
+    }
+
+    Report(std::string(replay.game) + " replay vs " + goldenPath, screen != ReadAll(goldenPath), 1);
+}
+
+
+// poopdye with its fish seeded, the shooter walking right and then firing,
+// seen while bullets fly at the fish and one of them flashes
+std::string PoopdyeKeys()
+{
+    std::string keys = "3000:DUMP,4500:DUMP,";
+
+    for (int i = 0; i < 60; i++)
+        keys += std::to_string(100 + i * 40) + ":RIGHT,";
+
+    for (int i = 0; i < 400; i++)
+        keys += std::to_string(2600 + i * 40) + ":ENTER,";
+
+    keys.pop_back();
+    return keys;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    bool golden = argc > 1 && std::string(argv[1]) == "--golden";
+
+    if (!golden)
+    {
+        Screen::Paint("BLACK");
+        std::srand(1);
+
+        CheckCollides(20000);
+        CheckMoves(4000);
+    }
+
+    CheckReplay({ "poopdye", "50x80", PoopdyeKeys(), "POOPDYE_SEED=42" }, golden);
+    CheckReplay({ "ping_pong", "40x100", "1000:DUMP,2500:DUMP" }, golden);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+#pragma once
+#include "style.h"
+#include "spatial.h"
+#include "slotmap.h"
+
+
+
+// An entity is only a handle: what it is comes from the components it has. Once
+// destroyed its handle is stale and finds none, even after its slot is reused.
+typedef SlotHandle Entity;
+
+
+// The components of one type, packed in a vector whatever entities own them, with
+// a table from entity slot to where its component is. Systems walk the packed
+// vector; removing one moves the last component into its place.
+template <typename T>
+class Components
+{
+    private:
+        std::vector<T> items;
+        std::vector<Entity> owners;   // of each item
+        std::vector<int> where;       // by entity slot, -1 for none
+
+
+    public:
+        // replaces the one the entity has, if any
+        T& Add(const Entity& entity, const T& item = T())
+        {
+            if (T *had = Get(entity))
+            {
+                *had = item;
+                return *had;
+            }
+
+            if (entity.slot >= (int) where.size())
+                where.resize(entity.slot + 1, -1);
+
+            where[entity.slot] = items.size();
+            items.push_back(item);
+            owners.push_back(entity);
+
+            return items.back();
+        }
+
+
+        // nullptr if the entity has none
+        T* Get(const Entity& entity)
+        {
+            if (entity.slot < 0 || entity.slot >= (int) where.size() || where[entity.slot] < 0)
+                return nullptr;
+
+            int at = where[entity.slot];
+            return (owners[at] == entity) ? &items[at] : nullptr;
+        }
+
+
+        void Remove(const Entity& entity)
+        {
+            if (!Get(entity))
+                return;
+
+            int at = where[entity.slot], last = items.size() - 1;
+
+            if (at != last)
+            {
+                items[at] = items[last];
+                owners[at] = owners[last];
+                where[owners[at].slot] = at;
+            }
+
+            items.pop_back();
+            owners.pop_back();
+            where[entity.slot] = -1;
+        }
+
+
+        int Size() const
+        {
+            return items.size();
+        }
+
+
+        // by place in the packed vector
+        T& operator[](int index)
+        {
+            return items[index];
+        }
+
+
+        Entity Owner(int index) const
+        {
+            return owners[index];
+        }
+};
+
+
+// acts on the ticks that are multiples of period
+class Timer
+{
+    public:
+        int period = 1;
+        bool due = false;   // this tick
+};
+
+
+// The entities of a scene and their components, and the systems that run over
+// them each tick: Step() finds who is due, Move() adds velocity to position, and
+// Render() brings the sprites to their positions. Entities with a size are kept
+// in a grid for Near(). The game decides what happens between the systems, walking
+// the entities with ForEach(), which lets it destroy any of them as it goes.
+class World
+{
+    private:
+        SlotMap<char> entities;   // kept for their handles only
+
+
+    public:
+        long long tick = 0;
+
+        Components<Coord> position, velocity;
+        Components<Coord> size;          // rows and columns of the box from position
+        Components<Figure*> sprite;      // drawn at position, not owned
+        Components<int> hitPoints, damage;
+        Components<Timer> timer;
+
+        SpatialGrid<Entity> grid;
+
+
+        Entity Create()
+        {
+            return entities.Insert(0);
+        }
+
+
+        bool Alive(const Entity& entity)
+        {
+            return entities.Get(entity) != nullptr;
+        }
+
+
+        // calls body(entity) for every entity there was when it started and is still alive;
+        // the slot map holds the destroyed ones back until the walk is over
+        template <typename Body>
+        void ForEach(Body body)
+        {
+            entities.ForEach([&](const Entity& entity, char&) { body(entity); });
+        }
+
+
+        // drops every component; the sprite is left to its owner
+        void Destroy(const Entity& entity)
+        {
+            if (!Alive(entity))
+                return;
+
+            position.Remove(entity);
+            velocity.Remove(entity);
+            size.Remove(entity);
+            sprite.Remove(entity);
+            hitPoints.Remove(entity);
+            damage.Remove(entity);
+            timer.Remove(entity);
+
+            grid.Remove(entity);
+            entities.Remove(entity);
+        }
+
+
+        // gives the entity a position and a box, and puts it in the grid
+        void Place(const Entity& entity, const Coord& where, const Coord& box)
+        {
+            position.Add(entity, where);
+            size.Add(entity, box);
+            grid.Insert(entity, where, where + box - Coord(1, 1));
+        }
+
+
+        // sizes the grid to the screen again after the terminal is resized, with everything placed in it
+        void Fit()
+        {
+            grid = SpatialGrid<Entity>();
+
+            for (int i = 0; i < size.Size(); i++)
+            {
+                Entity entity = size.Owner(i);
+                Coord at = *position.Get(entity);
+                grid.Insert(entity, at, at + size[i] - Coord(1, 1));
+            }
+        }
+
+
+        // the entities whose boxes overlap the box from topLeft to botRight
+        void Near(const Coord& topLeft, const Coord& botRight, std::vector<Entity>& found)
+        {
+            grid.Query(topLeft, botRight, found);
+        }
+
+
+        // the timer system: a new tick, and who is due on it
+        void Step()
+        {
+            tick++;
+
+            for (int i = 0; i < timer.Size(); i++)
+                timer[i].due = tick % timer[i].period == 0;
+        }
+
+
+        // true if the entity has a timer and it is due this tick
+        bool Due(const Entity& entity)
+        {
+            Timer *clock = timer.Get(entity);
+            return clock && clock->due;
+        }
+
+
+        // the movement system: every entity with a velocity and a position moves,
+        // on each tick if it has no timer and on the ticks it is due if it has one
+        void Move()
+        {
+            for (int i = 0; i < velocity.Size(); i++)
+            {
+                Entity entity = velocity.Owner(i);
+                Timer *clock = timer.Get(entity);
+                Coord *at = position.Get(entity);
+
+                if (!at || (clock && !clock->due))
+                    continue;
+
+                *at += velocity[i];
+
+                if (Coord *box = size.Get(entity))
+                    grid.Move(entity, *at, *at + *box - Coord(1, 1));
+            }
+        }
+
+
+        // the rendering system: sprites are moved to their entities' positions
+        void Render()
+        {
+            for (int i = 0; i < sprite.Size(); i++)
+            {
+                Coord *at = position.Get(sprite.Owner(i));
+
+                if (at && sprite[i]->thisState.coord != *at)
+                    sprite[i]->MoveTo(*at);
+            }
+        }
+};
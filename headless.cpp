@@ -0,0 +1,478 @@
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include "headless.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+
+
+long long Headless::now = 0;
+long long Headless::frames = 0;
+long long Headless::parseNanos = 0;
+long long Headless::worstBytes = 0;
+long long Headless::worstParseNanos = 0;
+
+static std::vector<std::pair<long long, int>> presses;   // scripted, taken from the front once due
+static std::vector<std::pair<long long, Coord>> resizes;  // scripted as well, in the order written
+static std::vector<long long> snapshots;                   // scripted too, sorted
+static std::string snapped;                                // the dumps of those taken
+static bool resized = true;
+
+static const char *KEY_NAMES[Key::COUNT] = { "UP", "DOWN", "RIGHT", "LEFT", "ENTER", "ESC" };
+
+
+
+VTerm::VTerm(int rows, int cols)
+{
+    this->rows = rows;
+    this->cols = cols;
+    grid.assign(rows * cols, Cell());
+}
+
+
+void VTerm::Resize(int rows, int cols)
+{
+    std::vector<Cell> resized(rows * cols, Cell());
+
+    for (int row = 0; row < std::min(rows, this->rows); row++)
+        std::copy_n(&grid[row * this->cols], std::min(cols, this->cols), &resized[row * cols]);
+
+    grid.swap(resized);
+    this->rows = rows;
+    this->cols = cols;
+
+    cursor = Coord(std::min(cursor.ROW, rows), std::min(cursor.COL, cols));
+    pendingWrap = false;
+}
+
+
+std::string VTerm::Row(int row)
+{
+    std::string glyphs;
+
+    for (int col = 1; col <= cols; col++)
+        glyphs += At(row, col).glyph;
+
+    glyphs.erase(glyphs.find_last_not_of(' ') + 1);
+    return glyphs;
+}
+
+
+std::string VTerm::Colors(int row, bool background)
+{
+    std::string colors;
+
+    for (int col = 1; col <= cols; col++)
+    {
+        const Cell& cell = At(row, col);
+        ColorId id = background ? cell.bgColor : (cell.glyph == ' ' && cell.style == 0) ? Palette::NONE : cell.fgColor;
+        colors += id ? char('a' + id - 1) : '.';
+    }
+
+    colors.erase(colors.find_last_not_of('.') + 1);
+    return colors;
+}
+
+
+void VTerm::LineFeed()
+{
+    if (cursor.ROW < rows)
+    {
+        cursor.ROW++;
+        return;
+    }
+
+    // scrolls, the new row taking the current background
+    std::copy(grid.begin() + cols, grid.end(), grid.begin());
+    std::fill(grid.end() - cols, grid.end(), Cell(' ', Palette::NONE, bgColor));
+}
+
+
+// like a VT, writing the last column leaves the cursor there until the next glyph wraps
+void VTerm::Put(char glyph)
+{
+    if (pendingWrap)
+    {
+        pendingWrap = false;
+        cursor.COL = 1;
+        LineFeed();
+    }
+
+    At(cursor.ROW, cursor.COL) = Cell(glyph, fgColor, bgColor, style);
+
+    if (cursor.COL < cols)
+        cursor.COL++;
+    else
+        pendingWrap = true;
+}
+
+
+void VTerm::Sgr()
+{
+    int n[8] = { }, count = 0;
+    const char *at = params.c_str();
+
+    // no parameters at all means 0
+    while (count < 8)
+    {
+        n[count++] = atoi(at);
+        at = strchr(at, ';');
+        if (!at++)
+            break;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        // 38;2;r;g;b and 48;2;r;g;b name the palette color with that rgb, NONE if there is none
+        if ((n[i] == 38 || n[i] == 48) && i + 4 < count && n[i + 1] == 2)
+        {
+            char rgb[16];
+            snprintf(rgb, sizeof rgb, "%d;%d;%d", n[i + 2], n[i + 3], n[i + 4]);
+
+            ColorId id = Palette::NONE;
+            for (ColorId other = 1; other < std::size(PALETTE_TABLE); other++)
+                if (strcmp(PALETTE_TABLE[other][1], rgb) == 0)
+                    id = other;
+
+            (n[i] == 38 ? fgColor : bgColor) = id;
+            i += 4;
+            continue;
+        }
+
+        switch (n[i])
+        {
+            case 0: style = 0; fgColor = bgColor = Palette::NONE; break;
+            case 1: style = StyleID("BOLD");   break;
+            case 3: style = StyleID("ITALIC"); break;
+            case 4: style = StyleID("LINE");   break;
+            case 9: style = StyleID("STRIKE"); break;
+            case 22: case 23: case 24: case 29: style = 0; break;
+            case 39: fgColor = Palette::NONE; break;
+            case 49: bgColor = Palette::NONE; break;
+        }
+    }
+}
+
+
+void VTerm::Control(char final)
+{
+    int n = atoi(params.c_str() + (params[0] == '?'));
+    int steps = std::max(n, 1);
+
+    pendingWrap = false;
+
+    switch (final)
+    {
+        case 'A': cursor.ROW = std::max(cursor.ROW - steps, 1);    break;
+        case 'B': cursor.ROW = std::min(cursor.ROW + steps, rows); break;
+        case 'C': cursor.COL = std::min(cursor.COL + steps, cols); break;
+        case 'D': cursor.COL = std::max(cursor.COL - steps, 1);    break;
+
+        case 'H':
+        {
+            const char *col = strchr(params.c_str(), ';');
+            cursor.ROW = std::clamp(steps, 1, rows);
+            cursor.COL = std::clamp(col ? atoi(col + 1) : 1, 1, cols);
+            break;
+        }
+
+        case 'J':
+            if (n == 2)
+                std::fill(grid.begin(), grid.end(), Cell(' ', Palette::NONE, bgColor));
+            break;
+
+        case 'm':
+            Sgr();
+            break;
+
+        case 'h':
+        case 'l':
+            if (params == "?25")
+                cursorHidden = final == 'l';
+            break;
+    }
+}
+
+
+void VTerm::Feed(const char *bytes, int count)
+{
+    this->bytes += count;
+
+    for (int i = 0; i < count; i++)
+    {
+        char c = bytes[i];
+
+        switch (state)
+        {
+            case GROUND:
+                if (c == '\033')
+                    state = ESCAPE;
+                else if (c == '\r')
+                {
+                    cursor.COL = 1;
+                    pendingWrap = false;
+                }
+                else if (c == '\n')
+                {
+                    LineFeed();
+                    pendingWrap = false;
+                }
+                else if (c == '\b')
+                {
+                    cursor.COL = std::max(cursor.COL - 1, 1);
+                    pendingWrap = false;
+                }
+                else if (c >= ' ')
+                    Put(c);
+                break;
+
+            case ESCAPE:
+                escapes++;
+                params.clear();
+                state = (c == '[') ? CSI : GROUND;
+                break;
+
+            case CSI:
+                if (c >= 0x40 && c <= 0x7e)
+                {
+                    Control(c);
+                    state = GROUND;
+                }
+                else
+                    params += c;
+                break;
+        }
+    }
+}
+
+
+
+VTerm& Headless::Term()
+{
+    // never destroyed, outBuff may still flush into it while the program exits
+    static VTerm *term = new VTerm(50, 188);
+    return *term;
+}
+
+
+void Headless::Press(long long at, int key)
+{
+    presses.insert(std::upper_bound(presses.begin(), presses.end(), std::make_pair(at, (int) Key::COUNT)), { at, key });
+}
+
+
+bool Headless::Script(const char *script)
+{
+    while (*script)
+    {
+        char name[8];
+        long long millis;
+        int used, rows, cols;
+
+        if (sscanf(script, "%lld:%dx%d%n", &millis, &rows, &cols, &used) == 3 && rows > 0 && cols > 0)
+        {
+            resizes.emplace_back(millis * 1000, Coord(rows, cols));
+
+            script += used;
+            if (*script == ',')
+                script++;
+
+            continue;
+        }
+
+        if (sscanf(script, "%lld:%7[A-Z]%n", &millis, name, &used) != 2)
+            return false;
+
+        int key = 0;
+        while (key < Key::COUNT && strcmp(KEY_NAMES[key], name) != 0)
+            key++;
+
+        if (strcmp(name, "DUMP") == 0)
+            Snapshot(millis * 1000);
+        else if (key == Key::COUNT)
+            return false;
+        else
+            Press(millis * 1000, key);
+
+        script += used;
+        if (*script == ',')
+            script++;
+    }
+
+    return true;
+}
+
+
+void Headless::Snapshot(long long at)
+{
+    snapshots.insert(std::upper_bound(snapshots.begin(), snapshots.end(), at), at);
+}
+
+
+void Headless::SetSize(int rows, int cols)
+{
+    Term().Resize(rows, cols);
+    resized = true;
+}
+
+
+bool Headless::Matches(const std::vector<Cell>& cells)
+{
+    const VTerm& term = Term();
+
+    if (cells.size() != term.grid.size())
+        return false;
+
+    for (size_t i = 0; i < cells.size(); i++)
+        if (cells[i] != term.grid[i])
+            return false;
+
+    return true;
+}
+
+
+void Headless::Dump(std::ostream& out)
+{
+    VTerm& term = Term();
+
+    for (int row = 1; row <= term.rows; row++)
+        out << term.Row(row) << '\n';
+
+    out << "-- foregrounds\n";
+    for (int row = 1; row <= term.rows; row++)
+        out << term.Colors(row, false) << '\n';
+
+    out << "-- backgrounds\n";
+    for (int row = 1; row <= term.rows; row++)
+        out << term.Colors(row, true) << '\n';
+}
+
+
+void Headless::Report(std::ostream& out)
+{
+    const VTerm& term = Term();
+    long long perFrame = std::max(frames, 1LL);
+
+    out << frames << " frames, " << term.bytes << " bytes and " << term.escapes << " escapes in all\n"
+        << "per frame: " << term.bytes / perFrame << " bytes (worst " << worstBytes << "), "
+        << term.escapes / perFrame << " escapes, " << parseNanos / perFrame << " ns to parse (worst "
+        << worstParseNanos << ")\n";
+}
+
+
+static void AtExit()
+{
+    if (const char *path = getenv("HEADLESS_DUMP"))
+    {
+        std::ofstream dump(path);
+        dump << snapped << "== at exit\n";
+        Headless::Dump(dump);
+    }
+
+    Headless::Report(std::cerr);
+}
+
+
+
+void Platform::Init()
+{
+    int rows, cols;
+    const char *size = getenv("HEADLESS_SIZE");
+    const char *keys = getenv("HEADLESS_KEYS");
+
+    if (size && sscanf(size, "%dx%d", &rows, &cols) == 2 && rows > 0 && cols > 0)
+        Headless::SetSize(rows, cols);
+
+    if (keys && !Headless::Script(keys))
+        std::cerr << "HEADLESS_KEYS: can't read \"" << keys << "\"\n";
+
+    atexit(AtExit);
+}
+
+
+void Platform::Restore()
+{
+    Write("\033[0m\033[?25h", 10);
+}
+
+
+// once per scripted press that is due
+bool Platform::KeyDown(int key)
+{
+    for (auto press = presses.begin(); press != presses.end() && press->first <= Headless::now; press++)
+    {
+        if (press->second == key)
+        {
+            presses.erase(press);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool Platform::ScreenSize(int& rows, int& cols)
+{
+    rows = Headless::Term().rows;
+    cols = Headless::Term().cols;
+    return true;
+}
+
+
+bool Platform::CursorPos(int& row, int& col)
+{
+    row = Headless::Term().cursor.ROW;
+    col = Headless::Term().cursor.COL;
+    return true;
+}
+
+
+bool Platform::Resized()
+{
+    while (!resizes.empty() && resizes.front().first <= Headless::now)
+    {
+        Headless::SetSize(resizes.front().second.ROW, resizes.front().second.COL);
+        resizes.erase(resizes.begin());
+    }
+
+    bool was = resized;
+    resized = false;
+    return was;
+}
+
+
+long long Platform::NowMicros()
+{
+    return Headless::now++;
+}
+
+
+void Platform::SleepCoarse(long long deadline)
+{
+    Headless::now = std::max(Headless::now, deadline);
+}
+
+
+void Platform::Write(const char *bytes, int count)
+{
+    auto start = std::chrono::steady_clock::now();
+    Headless::Term().Feed(bytes, count);
+    long long took = std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count();
+
+    Headless::frames++;
+    Headless::parseNanos += took;
+    Headless::worstBytes = std::max(Headless::worstBytes, (long long) count);
+    Headless::worstParseNanos = std::max(Headless::worstParseNanos, took);
+
+    while (!snapshots.empty() && snapshots.front() <= Headless::now)
+    {
+        std::stringstream dump;
+        dump << "== at " << snapshots.front() / 1000 << " ms\n";
+        Headless::Dump(dump);
+
+        snapped += dump.str();
+        snapshots.erase(snapshots.begin());
+    }
+}
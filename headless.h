@@ -0,0 +1,92 @@
+#pragma once
+#include "style.h"
+
+
+
+// An in-memory terminal: parses what is written to it into a grid of cells, the
+// same cells Screen draws with, so a frame can be checked against Screen's buffers.
+class VTerm
+{
+    private:
+        enum { GROUND, ESCAPE, CSI } state = GROUND;
+        std::string params;   // of the control sequence being read
+        bool pendingWrap = false;
+
+
+        void Put(char glyph);
+        void LineFeed();
+        void Control(char final);
+        void Sgr();
+
+
+    public:
+        int rows, cols;
+        std::vector<Cell> grid;
+        Coord cursor = { 1, 1 };
+        ColorId fgColor = Palette::NONE, bgColor = Palette::NONE;
+        StyleId style = 0;
+        bool cursorHidden = false;
+
+        long long bytes = 0, escapes = 0;
+
+        VTerm(int rows, int cols);
+
+        void Resize(int rows, int cols);
+        void Feed(const char *bytes, int count);
+
+        Cell& At(int row, int col)
+        {
+            return grid[(row - 1) * cols + col - 1];
+        }
+
+        // the glyphs of a row, trailing blanks dropped
+        std::string Row(int row);
+
+        // the colors of a row, a letter per cell from 'a' for RED on and '.' for none,
+        // trailing nones dropped; a plain blank has no foreground to show
+        std::string Colors(int row, bool background);
+};
+
+
+// Runs a game with no console: link headless.cpp instead of platform.cpp and the
+// Platform calls land here. Output goes to a VTerm, the clock is virtual and only
+// moves when slept on (and by a microsecond per read, so spins end), and keys come
+// from a script, so a whole session runs as fast as it can be drawn.
+//
+// Init() takes its settings from the environment:
+//   HEADLESS_SIZE  rows x cols of the terminal, 50x188 when unset
+//   HEADLESS_KEYS  presses as ms:KEY, comma separated, e.g. "100:RIGHT,250:ENTER",
+//                  resizes as ms:RxC, e.g. "500:40x100", and snapshots of the grid as
+//                  ms:DUMP, taken by the first frame written from then on
+//   HEADLESS_DUMP  file the snapshots and the final grid are written to at exit
+// and reports the frame statistics to stderr at exit.
+class Headless
+{
+    public:
+        static long long now;   // the virtual clock, in microseconds
+
+        // per frame, a frame being one write of the whole outBuff
+        static long long frames, parseNanos, worstBytes, worstParseNanos;
+
+
+        static VTerm& Term();
+
+        // a press of key at the virtual time at
+        static void Press(long long at, int key);
+
+        // presses written as in HEADLESS_KEYS, false at the first one that doesn't parse
+        static bool Script(const char *script);
+
+        // a snapshot of the grid at the virtual time at
+        static void Snapshot(long long at);
+
+        // resizes the terminal, which the next Platform::Resized() reports
+        static void SetSize(int rows, int cols);
+
+        // true if the terminal shows exactly cells, e.g. Screen::frontBuff
+        static bool Matches(const std::vector<Cell>& cells);
+
+        // the glyphs of the grid, then its foregrounds and backgrounds as Colors() writes them
+        static void Dump(std::ostream& out);
+        static void Report(std::ostream& out);
+};
@@ -1,69 +1,125 @@
-#include "C:\Users\User\Desktop\VSCode\Cpp\Modules\style.h"
+#include "style.h"
+#include "ecs.h"
 
 
-//BOUNDARIES
+//BOUNDARIES, the ones on the right and bottom edges are set by Layout()
 const Coord TOP_LC = { 2, 3 };  // top left corner
-const Coord TOP_RC = { 2, Screen::WIDTH - 3 };  //immediately at and beyond this padding level, the game ends
-const Coord BOT_LC = { Screen::HEIGHT - 3, 3 };
-const Coord BOT_RC = { Screen::HEIGHT - 3, Screen::WIDTH - 3 };
+Coord TOP_RC;  //immediately at and beyond this padding level, the game ends
+Coord BOT_LC;
+Coord BOT_RC;
 const std::string WALL_COLOR = "RED";
 
 
 //PAD
 const int PAD_HT = 7;  // height
 const int PAD_WD = 2;  // width
-const std::string PAD_FG = Screen::SCREEN_BG;
+const ColorId PAD_FG = Screen::SCREEN_BG;
 const std::string PAD_BG = "CYAN";
 
-Coord PAD_LC = { (TOP_RC.ROW + BOT_RC.ROW - PAD_HT ) / 2 + 1, TOP_RC.COL };  // pad left corner
+Coord PAD_LC;  // where the pad starts
 
 
 //BALL
-const Coord BALL_ST = { (3 * TOP_RC.ROW + BOT_RC.ROW) / 2, TOP_LC.COL + 2 };  // ball start position
-const std::vector<Coord> BALL_PTS = {
-    BALL_ST,
-    BALL_ST + Coord(-1, 1),
-    BALL_ST + Coord(0, 1),
-    BALL_ST + Coord(1, 1),
-    BALL_ST + Coord(0, 2),
-    BALL_ST + Coord(-1, 0),
-    BALL_ST + Coord(1, 0),
-    BALL_ST + Coord(-1, 2),
-    BALL_ST + Coord(1, 2)
-};
-
-std::string BALL_FG = Screen::SCREEN_BG;
+Coord BALL_ST;  // ball start position
+
+ColorId BALL_FG = Screen::SCREEN_BG;
 std::string BALL_BG = "RED";
 Coord BALL_DIR = { 1, 1 };  // ball will move down by default
 
 
+// the ball and the pad are entities: the ball moves by its velocity, the pad by the keys
+World* world;
+Entity ball, pad;
+
+
 // returns false if pad stuck
-bool MovePad(Block& pad, int where);
+bool MovePad(int where);
 
 // collision detection/bouncing
-bool ProcessMove(Block& ball, Block& pad);
+bool ProcessMove();
 
 // moves ball one step, return false if ball has collided
-bool MoveBall(Block& ball, Block& pad);
+bool MoveBall();
 
-void pause(int x = 1) { outBuff.flush(); MicroSleep(x s); }
+void pause(int x = 1) { Screen::Present(); MicroSleep(x s); }
 
 
+// the smallest terminal to play in, the pad covering at most half the height between the walls
+const int MIN_ROWS = 2 * PAD_HT + 6;
+const int MIN_COLS = 30;
 
-int main()
+
+// Places everything that depends on the terminal's size, at startup and after a resize.
+// False if the terminal is smaller than MIN_ROWS by MIN_COLS, everything is then placed
+// as if it were that size and what is beyond is cut off.
+bool Layout()
 {
-    Screen::SetStyle("HIDE");
-    Screen::SetColor("", "RED");
-    Screen::Paint("BLACK");
+    Screen::FitTerminal();
 
+    int rows = std::max(Screen::HEIGHT, MIN_ROWS);
+    int cols = std::max(Screen::WIDTH, MIN_COLS);
 
-    // CREATING THE WALLS
-    Screen::SetColor(WALL_COLOR);
+    TOP_RC = { 2, cols - 3 };
+    BOT_LC = { rows - 3, 3 };
+    BOT_RC = { rows - 3, cols - 3 };
+
+    PAD_LC = { (TOP_RC.ROW + BOT_RC.ROW - PAD_HT ) / 2 + 1, TOP_RC.COL };
+    BALL_ST = { (3 * TOP_RC.ROW + BOT_RC.ROW) / 2, TOP_LC.COL + 2 };
+
+    return rows == Screen::HEIGHT && cols == Screen::WIDTH;
+}
+
+
+void DrawWalls()
+{
+    Screen::SetLayer(Layer::SCENERY);
+    Screen::SetColor(WALL_COLOR, Screen::SCREEN_BG);
     Figure::Join(TOP_LC, TOP_RC, '-');
     Figure::Join(BOT_LC, BOT_RC, '-');
     Figure::Join(TOP_LC, BOT_LC, '|');
     Screen::Puts(TOP_LC, "+");
     Screen::Puts(BOT_LC, "+");
+    Screen::SetLayer(Layer::ACTORS);
+}
+
+
+// after a resize the walls are drawn again, the pad stays at the right edge and the ball between the walls
+void Relayout()
+{
+    Layout();
+
+    Screen::ClearLayer(Layer::SCENERY);
+    DrawWalls();
+
+    Coord& padAt = *world->position.Get(pad);
+    padAt = { std::clamp(padAt.ROW, TOP_RC.ROW + 1, BOT_RC.ROW - PAD_HT), TOP_RC.COL };
+
+    Coord& ballAt = *world->position.Get(ball);
+    ballAt = { std::clamp(ballAt.ROW, TOP_LC.ROW + 1, BOT_LC.ROW - 3), std::clamp(ballAt.COL, TOP_LC.COL + 1, TOP_RC.COL - 4) };
+
+    world->Render();
+}
+
+
+
+int main()
+{
+    Platform::Init();
+
+    if (!Layout())
+    {
+        std::cerr << "ping_pong needs a terminal of at least " << MIN_ROWS << " rows and " << MIN_COLS << " columns, this one has "
+                  << Screen::HEIGHT << " and " << Screen::WIDTH << std::endl;
+        return 1;
+    }
+
+    Screen::SetStyle("HIDE");
+    Screen::SetColor("", "RED");
+    Screen::Paint("BLACK");
+
+
+    // CREATING THE WALLS
+    DrawWalls();
 
 
     // MAKING THE PAD
@@ -72,77 +128,97 @@ int main()
     // VertLine pad_left(" ", PAD_HT - 2, { PAD_LC.ROW + 1 , PAD_LC.COL });
     // VertLine pad_right(" ", PAD_HT - 2, { PAD_LC.ROW + 1, PAD_LC.COL + PAD_WD - 1 });
 
-    Block pad(" ", PAD_WD, PAD_HT, PAD_LC, PAD_BG);
-    pad.ChangeColor(PAD_FG, PAD_BG);
+    Block padBlock(" ", PAD_WD, PAD_HT, PAD_LC, PAD_BG);
+    padBlock.ChangeColor(PAD_FG, PAD_BG);
 
 
     // MAKING THE BALL
-    // std::vector<Figure*> points;
-    // for (Coord coord : BALL_PTS)
-    //     points.push_back(new Point(coord, "", "", ' '));
+    Sprite ballSprite({ "    ", "    ", "    " }, BALL_ST, BALL_FG, BALL_BG, '\0');
+
+
+    World scene;
+    world = &scene;
 
-    Block ball(" ", 4, 3, BALL_ST, BALL_BG);
-    ball.ChangeColor(BALL_FG, BALL_BG);
-    //ball.ChangeColor(BALL_FG, BALL_BG);
+    pad = world->Create();
+    world->position.Add(pad, PAD_LC);
+    world->sprite.Add(pad, &padBlock);
+
+    ball = world->Create();
+    world->position.Add(ball, BALL_ST);
+    world->velocity.Add(ball, BALL_DIR);
+    world->sprite.Add(ball, &ballSprite);
 
 
     // MOVING THE BALL, COLLISIONS
-    while (MoveBall(ball, pad))
+    int laidOut = Screen::resizes;
+
+    while (MoveBall())
     {
+        if (laidOut != Screen::resizes)
+        {
+            laidOut = Screen::resizes;
+            Relayout();
+        }
+
         // change i to increase speed of pad
         for (int i = 0; i < 2; i++)
         {
-            if (GetAsyncKeyState(VK_UP) & 0x8000)
-                MovePad(pad, Dir::UP);
+            if (Platform::KeyDown(Key::UP))
+                MovePad(Dir::UP);
 
-            if (GetAsyncKeyState(VK_DOWN) & 0x8000)
-                MovePad(pad, Dir::DOWN);
+            if (Platform::KeyDown(Key::DOWN))
+                MovePad(Dir::DOWN);
         }
-        
-        outBuff.flush();
+
+        world->Render();
+        Screen::Present();
         MicroSleep(20 ms);
     }
 }
 
 
-bool MovePad(Block& pad, int where)
+bool MovePad(int where)
 {
+    Coord& padAt = *world->position.Get(pad);
+
     if (where == Dir::UP)
     {
-        if (PAD_LC.ROW == TOP_RC.ROW + 1)
+        if (padAt.ROW == TOP_RC.ROW + 1)
             return false;
         
-        pad.MoveBy({ -1, 0 });
-        PAD_LC.ROW--;
+        padAt.ROW--;
     }
     else if (where == Dir::DOWN)
     {
-        if (PAD_LC.ROW + PAD_HT == BOT_RC.ROW)
+        if (padAt.ROW + PAD_HT == BOT_RC.ROW)
             return false;
 
-        pad.MoveBy({ 1, 0 });
-        PAD_LC.ROW++;
+        padAt.ROW++;
     }
 
     return true;
 }
 
 
-bool ProcessMove(Block& ball, Block& pad)
+bool ProcessMove()
 {
+    Figure& ballBody = **world->sprite.Get(ball);
+    Figure& padBody = **world->sprite.Get(pad);
+    Coord& ballDir = *world->velocity.Get(ball);
+
     // top and bottom walls
-    if (BALL_DIR.ROW == 1 && ball.Collides(BOT_LC, "horz") || BALL_DIR.ROW == -1 && ball.Collides(TOP_LC, "horz"))
-        BALL_DIR.ROW *= -1;
+    if ((ballDir.ROW == 1 && ballBody.Collides(BOT_LC, "horz")) || (ballDir.ROW == -1 && ballBody.Collides(TOP_LC, "horz")))
+        ballDir.ROW *= -1;
 
     // left wall
-    else if (BALL_DIR.COL == -1 && ball.Collides(TOP_LC, "vert"))
-        BALL_DIR.COL *= -1;
+    else if (ballDir.COL == -1 && ballBody.Collides(TOP_LC, "vert"))
+        ballDir.COL *= -1;
 
-    // right-side
-    else if (BALL_DIR.COL == 1 && ball.Collides(TOP_RC, "vert"))
+    // right-side: the pad sends the ball back if the ball's next step lands on one of its cells
+    else if (ballDir.COL == 1 && ballBody.Collides(TOP_RC, "vert"))
     {
-        if (ball.Collides(pad))
-            BALL_DIR.COL *= -1;
+        if (ballBody.Overlaps(padBody, ballDir))
+            ballDir.COL *= -1;
         else
             return true;
     }
@@ -151,8 +227,9 @@ bool ProcessMove(Block& ball, Block& pad)
 }
 
 
-bool MoveBall(Block& ball, Block& pad)
+bool MoveBall()
 {
-    ball.MoveBy(BALL_DIR);
-    return !ProcessMove(ball, pad);
+    world->Move();
+    world->Render();
+    return !ProcessMove();
 }
\ No newline at end of file
@@ -0,0 +1,416 @@
+#include "platform.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#include <io.h>
+#pragma comment(lib, "winmm")
+#else
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#endif
+
+
+
+#ifdef _WIN32
+
+static DWORD savedMode;
+static bool modeSaved = false;
+
+static const int VK_CODES[Key::COUNT] = { VK_UP, VK_DOWN, VK_RIGHT, VK_LEFT, VK_RETURN, VK_ESCAPE };
+
+static int lastRows = -1, lastCols = -1;
+
+
+void Platform::Init()
+{
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    if (!modeSaved && GetConsoleMode(out, &savedMode))
+    {
+        modeSaved = true;
+        SetConsoleMode(out, savedMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+        atexit(Platform::Restore);
+    }
+}
+
+
+void Platform::Restore()
+{
+    Write("\033[0m\033[?25h", 10);
+
+    if (modeSaved)
+        SetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), savedMode);
+}
+
+
+bool Platform::KeyDown(int key)
+{
+    return GetAsyncKeyState(VK_CODES[key]) & 0x8000;
+}
+
+
+bool Platform::ScreenSize(int& rows, int& cols)
+{
+    CONSOLE_SCREEN_BUFFER_INFO csbi = { };
+
+    if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi))
+        return false;
+
+    rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+    cols = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+    return true;
+}
+
+
+bool Platform::CursorPos(int& row, int& col)
+{
+    CONSOLE_SCREEN_BUFFER_INFO csbi = { };
+
+    if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi))
+        return false;
+
+    row = csbi.dwCursorPosition.Y - csbi.srWindow.Top + 1;
+    col = csbi.dwCursorPosition.X - csbi.srWindow.Left + 1;
+    return true;
+}
+
+
+// the console has no resize signal that leaves the input alone, so compare sizes
+bool Platform::Resized()
+{
+    int rows, cols;
+
+    if (!ScreenSize(rows, cols) || (rows == lastRows && cols == lastCols))
+        return false;
+
+    lastRows = rows;
+    lastCols = cols;
+    return true;
+}
+
+
+long long Platform::NowMicros()
+{
+    static LARGE_INTEGER frequency = [] { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    return now.QuadPart / frequency.QuadPart * 1000000 + now.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+}
+
+
+// Sleep() rounds up to the timer tick, 15.6 ms unless asked for 1 ms; that is asked for
+// before the first sleep, which is the one sleepSlack is measured from, and given back at exit
+static void EndFineTimer()
+{
+    timeEndPeriod(1);
+}
+
+
+void Platform::SleepCoarse(long long deadline)
+{
+    static bool fineTimer = false;
+
+    if (!fineTimer)
+    {
+        fineTimer = true;
+        timeBeginPeriod(1);
+        atexit(EndFineTimer);
+    }
+
+    long long left = deadline - NowMicros();
+
+    if (left >= 1000)
+        Sleep(left / 1000);
+}
+
+
+void Platform::Write(const char *bytes, int count)
+{
+    while (count > 0)
+    {
+        int done = _write(1, bytes, count);
+
+        if (done < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        bytes += done;
+        count -= done;
+    }
+}
+
+
+#else
+
+
+static termios savedTermios;
+static bool termiosSaved = false;
+
+// presses decoded from stdin and not yet taken by KeyDown
+static int pending[Key::COUNT];
+
+// bytes of an escape sequence that was split across reads, kept since partialSince;
+// if no more come within ESC_WAIT it was the Esc key on its own
+static char partial[8];
+static int partialLength = 0;
+static long long partialSince = 0;
+static const long long ESC_WAIT = 20000;
+
+// set by SIGWINCH, starts set so the first Resized() reports the size
+static volatile sig_atomic_t resized = 1;
+
+
+static void OnSignal(int sig)
+{
+    Platform::Restore();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+
+static void OnResize(int)
+{
+    resized = 1;
+}
+
+
+void Platform::Init()
+{
+    signal(SIGWINCH, OnResize);
+
+    if (termiosSaved || !isatty(0) || tcgetattr(0, &savedTermios) != 0)
+        return;
+
+    termiosSaved = true;
+
+    // no line buffering or echo and reads that never block; ISIG stays so ^C still works
+    termios raw = savedTermios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(0, TCSANOW, &raw);
+
+    atexit(Platform::Restore);
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    signal(SIGHUP, OnSignal);
+    signal(SIGQUIT, OnSignal);
+}
+
+
+// async-signal-safe, it runs from OnSignal too
+void Platform::Restore()
+{
+    Write("\033[0m\033[?25h", 10);
+
+    if (termiosSaved)
+        tcsetattr(0, TCSANOW, &savedTermios);
+}
+
+
+// Reads whatever stdin holds and turns arrow key sequences (ESC [ x or ESC O x), Enter
+// and Esc into presses. A trailing partial sequence waits for the next read, or is
+// taken for Esc once ESC_WAIT has passed without more input.
+static void PollKeys(char *bytes = nullptr, int count = 0)
+{
+    char input[64];
+    int length = partialLength;
+    bool fresh = count > 0;   // bytes came in this time
+
+    memcpy(input, partial, partialLength);
+
+    if (bytes)
+    {
+        memcpy(input + length, bytes, count);
+        length += count;
+    }
+    else
+    {
+        // poll first, stdin may be a pipe that read would block on
+        pollfd in = { 0, POLLIN, 0 };
+
+        if (poll(&in, 1, 0) > 0)
+        {
+            int got = read(0, input + length, sizeof input - length);
+            if (got > 0)
+            {
+                length += got;
+                fresh = true;
+            }
+        }
+    }
+
+    partialLength = 0;
+
+    for (int i = 0; i < length; i++)
+    {
+        char c = input[i];
+
+        if (c == '\r' || c == '\n')
+            pending[Key::ENTER]++;
+        else if (c == '\033')
+        {
+            // followed by anything but a sequence introducer, it was Esc
+            if (i + 1 < length && input[i + 1] != '[' && input[i + 1] != 'O')
+            {
+                pending[Key::ESC]++;
+                continue;
+            }
+
+            if (length - i < 3)
+            {
+                if (!fresh && Platform::NowMicros() - partialSince >= ESC_WAIT)
+                {
+                    pending[Key::ESC]++;
+                    break;
+                }
+
+                if (fresh)
+                    partialSince = Platform::NowMicros();
+
+                partialLength = length - i;
+                memcpy(partial, input + i, partialLength);
+                break;
+            }
+
+            if (input[i + 1] == '[' || input[i + 1] == 'O')
+            {
+                switch (input[i + 2])
+                {
+                    case 'A': pending[Key::UP]++;    break;
+                    case 'B': pending[Key::DOWN]++;  break;
+                    case 'C': pending[Key::RIGHT]++; break;
+                    case 'D': pending[Key::LEFT]++;  break;
+                }
+
+                i += 2;
+            }
+        }
+    }
+}
+
+
+bool Platform::KeyDown(int key)
+{
+    PollKeys();
+
+    if (!pending[key])
+        return false;
+
+    pending[key]--;
+    return true;
+}
+
+
+bool Platform::ScreenSize(int& rows, int& cols)
+{
+    winsize size;
+
+    if (ioctl(1, TIOCGWINSZ, &size) != 0 || size.ws_row == 0 || size.ws_col == 0)
+        return false;
+
+    rows = size.ws_row;
+    cols = size.ws_col;
+    return true;
+}
+
+
+bool Platform::Resized()
+{
+    if (!resized)
+        return false;
+
+    resized = 0;
+    return true;
+}
+
+
+// asks the terminal (ESC [ 6 n) and waits up to 100 ms for ESC [ row ; col R
+bool Platform::CursorPos(int& row, int& col)
+{
+    if (!termiosSaved)
+        return false;
+
+    Write("\033[6n", 4);
+
+    char reply[32];
+    int length = 0;
+    long long deadline = NowMicros() + 100000;
+
+    while (length < (int) sizeof reply - 1 && NowMicros() < deadline)
+    {
+        pollfd in = { 0, POLLIN, 0 };
+
+        if (poll(&in, 1, 10) <= 0 || read(0, reply + length, 1) != 1)
+            continue;
+
+        if (reply[length++] != 'R')
+            continue;
+
+        reply[length] = '\0';
+
+        // the reply is the last ESC [ in there, keys typed before it are still presses
+        int start = length - 1;
+        while (start > 0 && !(reply[start - 1] == '\033' && reply[start] == '['))
+            start--;
+
+        if (start > 0 && sscanf(reply + start - 1, "\033[%d;%dR", &row, &col) == 2)
+        {
+            PollKeys(reply, start - 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+long long Platform::NowMicros()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+
+void Platform::SleepCoarse(long long deadline)
+{
+    timespec wake = { (time_t) (deadline / 1000000), (long) (deadline % 1000000 * 1000) };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR) { }
+}
+
+
+void Platform::Write(const char *bytes, int count)
+{
+    while (count > 0)
+    {
+        int done = write(1, bytes, count);
+
+        if (done < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        bytes += done;
+        count -= done;
+    }
+}
+
+#endif
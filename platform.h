@@ -0,0 +1,42 @@
+#pragma once
+
+
+
+namespace Key
+{
+    enum Code {
+        UP, DOWN, RIGHT, LEFT, ENTER, ESC,
+        COUNT
+    };
+}
+
+
+// Everything that differs between the Windows console and a POSIX terminal.
+// platform.cpp picks the backend at build time from _WIN32.
+class Platform
+{
+    public:
+        // unbuffered, unechoed input and escape sequence output, undone at exit
+        static void Init();
+        static void Restore();
+
+        // Windows: true while the key is held.
+        // POSIX: true once per press the tty delivered, autorepeat included.
+        static bool KeyDown(int key);
+
+        // the terminal's size and the real cursor position, false when they can't be had
+        static bool ScreenSize(int& rows, int& cols);
+        static bool CursorPos(int& row, int& col);
+
+        // true on the first call and whenever the terminal may have been resized since the last
+        static bool Resized();
+
+        // microseconds on a monotonic clock
+        static long long NowMicros();
+
+        // sleeps until deadline on the NowMicros clock, maybe a little past it
+        static void SleepCoarse(long long deadline);
+
+        // straight to stdout, retrying short writes
+        static void Write(const char *bytes, int count);
+};
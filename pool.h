@@ -0,0 +1,194 @@
+#pragma once
+#include "style.h"
+#include <new>
+#include <utility>
+
+
+
+// Fixed-size slots for one type, handed out from a free list and taken back into
+// it, so making and dropping figures over and over stops reaching the heap once
+// the pool has grown to the most there have been at once. Slots come CHUNK at a
+// time and are only given back to the heap with the pool, which destroys the
+// items still live first.
+template <typename T, int CHUNK = 32>
+class Pool
+{
+    private:
+        class Slot
+        {
+            public:
+                union
+                {
+                    Slot *next;
+                    alignas(T) unsigned char bytes[sizeof(T)];
+                };
+                bool live;
+        };
+
+        std::vector<Slot*> chunks;
+        Slot *freeList = nullptr;
+        int live = 0;
+
+
+    public:
+        Pool() { }
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+
+        template <typename... Args>
+        T* New(Args&&... args)
+        {
+            if (!freeList)
+            {
+                Slot *chunk = new Slot[CHUNK];
+                chunks.push_back(chunk);
+
+                for (int i = CHUNK; i--; )
+                {
+                    chunk[i].next = freeList;
+                    chunk[i].live = false;
+                    freeList = &chunk[i];
+                }
+            }
+
+            Slot *slot = freeList;
+            freeList = slot->next;
+            slot->live = true;
+            live++;
+
+            return new (slot->bytes) T(std::forward<Args>(args)...);
+        }
+
+
+        void Delete(T *item)
+        {
+            if (!item)
+                return;
+
+            item->~T();
+
+            Slot *slot = reinterpret_cast<Slot*>(item);
+            slot->live = false;
+            slot->next = freeList;
+            freeList = slot;
+            live--;
+        }
+
+
+        // items made and not yet deleted
+        int Live() const
+        {
+            return live;
+        }
+
+
+        ~Pool()
+        {
+            for (Slot *chunk : chunks)
+            {
+                for (int i = 0; i < CHUNK; i++)
+                    if (chunk[i].live)
+                        reinterpret_cast<T*>(chunk[i].bytes)->~T();
+
+                delete[] chunk;
+            }
+        }
+};
+
+
+// Memory for everything that lives as long as a scene: items are placed one after
+// another and all destroyed at once by Release(), which keeps the memory for the
+// next scene. Items that need destroying are destroyed in the reverse order they
+// were made in. The games don't need one: the figures of their one scene live on
+// main's stack, and what comes and goes with play is in Pools. bench makes the
+// figures of each case in one and releases them between cases.
+class Arena
+{
+    private:
+        class Chunk
+        {
+            public:
+                char *memory;
+                size_t size;
+        };
+
+        class Cleanup
+        {
+            public:
+                void (*destroy)(void *item);
+                void *item;
+        };
+
+        std::vector<Chunk> chunks;
+        std::vector<Cleanup> cleanups;
+        size_t chunkSize;
+        size_t current = 0, used = 0;   // the chunk being filled and how far
+
+
+    public:
+        Arena(size_t chunkSize = 64 * 1024)
+        {
+            this->chunkSize = chunkSize;
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+
+        // align is a power of two
+        void* Allocate(size_t size, size_t align)
+        {
+            while (true)
+            {
+                if (current == chunks.size())
+                    chunks.push_back({ new char[std::max(chunkSize, size + align)], std::max(chunkSize, size + align) });
+
+                Chunk& chunk = chunks[current];
+                uintptr_t start = (uintptr_t) chunk.memory;
+                uintptr_t at = (start + used + align - 1) & ~(uintptr_t) (align - 1);
+
+                if (at + size <= start + chunk.size)
+                {
+                    used = at + size - start;
+                    return (void *) at;
+                }
+
+                current++;
+                used = 0;
+            }
+        }
+
+
+        template <typename T, typename... Args>
+        T* New(Args&&... args)
+        {
+            T *item = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+            if constexpr (!std::is_trivially_destructible<T>::value)
+                cleanups.push_back({ [](void *item) { ((T *) item)->~T(); }, item });
+
+            return item;
+        }
+
+
+        // destroys everything made since the last Release, the memory is kept
+        void Release()
+        {
+            for (size_t i = cleanups.size(); i--; )
+                cleanups[i].destroy(cleanups[i].item);
+
+            cleanups.clear();
+            current = 0;
+            used = 0;
+        }
+
+
+        ~Arena()
+        {
+            Release();
+
+            for (Chunk& chunk : chunks)
+                delete[] chunk.memory;
+        }
+};
@@ -1,13 +1,15 @@
 // wherever style.h and style.cpp are stored in
-#include "C:\Users\User\Desktop\VSCode\Cpp\Modules\style.h"
+#include "style.h"
+#include "scheduler.h"
+#include "ecs.h"
+#include "pool.h"
 #include <ctime>
+#include <memory>
 
 
-// Boundary
+// Boundary, the rest of it is set by Layout() from the terminal's size
 const Coord TOP_LC = { 2, 3 };
-const Coord BOT_LC = { Screen::HEIGHT - TOP_LC.ROW, TOP_LC.COL };
-const Coord TOP_RC = { TOP_LC.ROW, Screen::WIDTH - TOP_LC.COL };
-const Coord BOT_RC = { Screen::HEIGHT - TOP_LC.ROW, Screen::WIDTH - TOP_LC.COL };
+Coord BOT_LC, TOP_RC, BOT_RC;
 
 
 // Tank
@@ -16,130 +18,118 @@ const int TANK_H = 20;
 const std::string TANK_COLOR = "OCHRE";
 
 
-// Shooter
-const Coord SHOOT_TIP = BOT_LC + Coord(-3, 4);
-const Coord SHOOT_MAP[9] =
+// Shooter, its tip in the middle of the top row
+Coord SHOOT_TIP;
+const std::vector<std::string> SHOOT_PICTURE =
 {
-    SHOOT_TIP,
-    SHOOT_TIP + Coord(1, -1),
-    SHOOT_TIP + Coord(1, 0),
-    SHOOT_TIP + Coord(1, 1),
-    SHOOT_TIP + Coord(2, -2),
-    SHOOT_TIP + Coord(2, -1),
-    SHOOT_TIP + Coord(2, 0),
-    SHOOT_TIP + Coord(2, 1),
-    SHOOT_TIP + Coord(2, 2)
+    "  *  ",
+    " *** ",
+    "*****"
 };
 const std::string SHOOT_COLOR = "GREEN";
 
 
 // Fish
-Coord FISH_TOP = { TOP_LC.ROW + TANK_H + 3, (TOP_LC.COL + TOP_RC.COL) / 2 };
+Coord FISH_TOP;
 
 
-class Fish
-{
-    private:
-        int width, height;
-        std::string color;
-        Group* elements;
-        int hitPoints;
+// The smallest terminal the game fits in: the three fish under the tanks and the shooter
+// a few rows below them, and the boulder between the two tanks with room for the fish
+const int MIN_ROWS = TOP_LC.ROW + TANK_H + 3 + 8 + 7;
+const int MIN_COLS = 40;
 
 
-    public:
-        int freq;
-        Coord dir = { 0, 1 };
-        Coord vertex;
+// the screen is sized once the game starts and again whenever the terminal is resized, so
+// is everything placed against its edges. False if the terminal is smaller than MIN_ROWS
+// by MIN_COLS, everything is then placed as if it were that size and what is beyond is cut off.
+bool Layout()
+{
+    Screen::FitTerminal();
 
-        Fish(const Coord& vertex, int freq = 4, int hitPoints = 1, int width = 9, int height = 2, std::string color = "BATHROOM") : width(width), height(height), color(color), freq(freq), vertex(vertex), hitPoints(hitPoints)
-        {
-            std::vector<Figure*> points;
+    int rows = std::max(Screen::HEIGHT, MIN_ROWS);
+    int cols = std::max(Screen::WIDTH, MIN_COLS);
 
-            for (int i = 0; i < height; i++)
-            {
-                points.push_back(new Point(vertex + Coord(i, 0), color, "", '+'));
-                points.push_back(new Point(vertex + Coord(i, width - 1), color, "", '+'));
-            }
+    BOT_LC = { rows - TOP_LC.ROW, TOP_LC.COL };
+    TOP_RC = { TOP_LC.ROW, cols - TOP_LC.COL };
+    BOT_RC = { rows - TOP_LC.ROW, cols - TOP_LC.COL };
 
-            for (int i = 1; i < width - 1; i++) {
-                points.push_back(new Point(vertex + Coord(0, i), color, "", '-'));
-            }
-
-            for (int i = 1; i < width - 1; i++)
-            {
-                char c = (i == (width - 1) / 2) ? '.' : '-';
-                points.push_back(new Point(vertex + Coord(height - 1, i), color, "", c));
-            }
+    SHOOT_TIP = BOT_LC + Coord(-3, 4);
 
-            elements = new Group(points);
-        }
+    return rows == Screen::HEIGHT && cols == Screen::WIDTH;
+}
 
 
-        void Move()
-        {
-            if (dir.COL == 1 && elements->Collides(TOP_RC, "all") || dir.COL == -1 && elements->Collides(TOP_LC, "all")) {
-                dir = { 0, -dir.COL };
-            }
+// Fish are entities: an outline of 9x2 cells moving sideways every so many ticks,
+// with hit points that bullets take down
+Entity MakeFish(World& world, Pool<Sprite>& bodies, const Coord& vertex, int freq = 4, int hitPoints = 1, int width = 9, int height = 2, const std::string& color = "BATHROOM")
+{
+    std::vector<std::string> picture(height, '+' + std::string(width - 2, ' ') + '+');
 
-            elements->MoveBy(dir);
-            vertex.COL += dir.COL;
-        }
+    picture.front() = '+' + std::string(width - 2, '-') + '+';
+    picture.back() = picture.front();
+    picture.back()[(width - 1) / 2] = '.';
 
+    Sprite *body = bodies.New(picture, vertex, color);
 
-        bool DealHit()
-        {
-            Screen::SaveState();
-
-            for (auto it = colors.begin(); it != colors.end(); it++)
-            {
-                elements->ChangeColor(it->first);
-                Pause(30 ms);
-            }
-            if (--hitPoints == 0)
-            {
-                elements->Clear(false);
-                Screen::RetrieveState();
-                return true;
-            }
-                      
-            Screen::RetrieveState();
-            return false;
-        }
+    Entity fish = world.Create();
+    world.Place(fish, vertex, { height, width });
+    world.velocity.Add(fish, { 0, 1 });
+    world.sprite.Add(fish, body);
+    world.hitPoints.Add(fish, hitPoints);
+    world.timer.Add(fish, { freq });
 
+    return fish;
+}
 
-        bool IsAlive()
-        {
-            return hitPoints != 0;
-        }
 
+// turns the fish back before it reaches a wall
+void TurnFish(World& world, const Entity& fish)
+{
+    Figure *body = *world.sprite.Get(fish);
+    Coord& dir = *world.velocity.Get(fish);
 
-        Coord getBottom()
-        {
-            return { vertex.ROW + height - 1, vertex.COL + (width - 1) / 2 };
-        }
+    if ((dir.COL == 1 && body->Collides(TOP_RC, "all")) || (dir.COL == -1 && body->Collides(TOP_LC, "all"))) {
+        dir = { 0, -dir.COL };
+    }
+}
 
 
-        ~Fish()
-        {
-            elements->Clear();
-        }
-};
+// the middle of its bottom row, which a bullet has to reach
+Coord FishBottom(World& world, const Entity& fish)
+{
+    Coord size = *world.size.Get(fish);
+    return *world.position.Get(fish) + Coord(size.ROW - 1, (size.COL - 1) / 2);
+}
 
 
 void MakeTank(const Coord& where);
+void DrawScenery();
 int RandInt(int st, int end);
 int RandInt(int pool[], int length);
 
 
 int main()
 {
+    Platform::Init();
+
+    if (!Layout())
+    {
+        std::cerr << "poopdye needs a terminal of at least " << MIN_ROWS << " rows and " << MIN_COLS << " columns, this one has "
+                  << Screen::HEIGHT << " and " << Screen::WIDTH << std::endl;
+        return 1;
+    }
+
+    FISH_TOP = { TOP_LC.ROW + TANK_H + 3, (TOP_LC.COL + TOP_RC.COL) / 2 };
+
+    if (getenv("POOPDYE_STATS"))
+        Screen::ReportStatsAtExit();
+
     Screen::Paint("BLACK");
     Screen::SetStyle("HIDE");
 
     
-    // Tank
-    MakeTank(TOP_LC);
-    MakeTank(TOP_RC - Coord(0, TANK_W - 1));
+    // Scenery, drawn once and again after a resize: what moves over it shows it again as it leaves
+    DrawScenery();
 
     
     // Poop
@@ -149,161 +139,258 @@ int main()
     bool wormDance = false;
 
 
-    // Wall
-    Screen::SetColor("WHITE", Screen::SCREEN_BG);
-    Figure::Join(TOP_LC + Coord(TANK_H, 0), BOT_LC, '+');
-    Figure::Join(TOP_RC + Coord(TANK_H, 0), BOT_RC, '+');
-    Figure::Join(BOT_LC, BOT_RC, '=');
-
-
     // Shooter
-    std::vector<Figure*> points;
-    for (const auto& coord : SHOOT_MAP) {
-        points.push_back(new Point(coord, SHOOT_COLOR));
-    }
-    Group shooter(points);
+    Sprite shooter(SHOOT_PICTURE, SHOOT_TIP - Coord(0, 2), SHOOT_COLOR);
 
 
-    // Bullet
-    std::vector<Point*> bullets;
+    // Everything that moves on its own is an entity of the world
+    World world;
+    Pool<Sprite> bodies;
+    Pool<Point> shots;
 
 
-    // Boulder
+    // Boulder: it grows and shrinks by its velocity rather than moving
     Block boulder(" ", TOP_RC.COL - TOP_LC.COL - 2 * TANK_W + 1, TANK_H, TOP_LC + Coord(1, TANK_W), "GRAY");
-    Coord boulderDir = { 1, 0 };
+    Entity boulderId = world.Create();
+    world.sprite.Add(boulderId, &boulder);
+    world.velocity.Add(boulderId, { 1, 0 });
+    world.timer.Add(boulderId, { 8 });
 
 
-    // Fish
-    std::srand(time(0));
+    // Fish, POOPDYE_SEED fixes them for a replay
+    std::srand(getenv("POOPDYE_SEED") ? atoi(getenv("POOPDYE_SEED")) : time(0));
     int freqPool[] = { 2, 3, 4, 6, 8, 12, 24 };
-    std::vector<Fish*> fishes = {
-        new Fish(FISH_TOP, RandInt(freqPool, 7), RandInt(1, 5)),
-        new Fish(FISH_TOP + Coord(3, 0), RandInt(freqPool, 7), RandInt(1, 3)),
-        new Fish(FISH_TOP + Coord(6, 0), RandInt(freqPool, 7), RandInt(1, 2))
-    };
 
+    MakeFish(world, bodies, FISH_TOP, RandInt(freqPool, 7), RandInt(1, 5));
+    MakeFish(world, bodies, FISH_TOP + Coord(3, 0), RandInt(freqPool, 7), RandInt(1, 3));
+    MakeFish(world, bodies, FISH_TOP + Coord(6, 0), RandInt(freqPool, 7), RandInt(1, 2));
+
+    // bullets only look for fish in the cells around them
+    std::vector<Entity> hits;
+    std::vector<Entity> flashing;
+
+
+    // Movement: a fixed 6 ms tick, everything else runs every so many ticks
+    Scheduler sched(6 ms);
+    bool loaded = true;
+    bool stunk = false;
+    int laidOut = Screen::resizes;
+
+    // a resize is picked up by the last frame: what stands against the right and bottom
+    // edges follows them, the fish are kept between the walls and the grid is sized again
+    sched.Every(1, [&]()
+    {
+        if (laidOut == Screen::resizes) return;
+        laidOut = Screen::resizes;
+
+        Coord oldRight = TOP_RC, oldTip = SHOOT_TIP;
+        Layout();
+
+        Screen::ClearLayer(Layer::SCENERY);
+        DrawScenery();
 
-    // Movement
-    int counter = 1;
+        poop2.MoveBy({ 0, TOP_RC.COL - oldRight.COL });
+        boulder.Reframe({ 0, TOP_RC.COL - oldRight.COL });
 
-    while (true)
+        int shooterCol = std::clamp(shooter.thisState.coord.COL, TOP_LC.COL + 1, TOP_RC.COL - 5);
+        shooter.MoveTo({ shooter.thisState.coord.ROW + SHOOT_TIP.ROW - oldTip.ROW, shooterCol });
+
+        for (int i = 0; i < world.hitPoints.Size(); i++)
+        {
+            Entity fish = world.hitPoints.Owner(i);
+            Coord& at = *world.position.Get(fish);
+            at.COL = std::min(at.COL, TOP_RC.COL - world.size.Get(fish)->COL);
+        }
+
+        if (world.hitPoints.Size() == 0) FISH_TOP = BOT_LC;
+
+        world.Fit();
+        world.Render();
+    });
+
+    sched.Every(1, [&]()
     {
-        if (!shooter.Collides(TOP_RC, "vert", 2) && GetAsyncKeyState(VK_RIGHT) & 0x8000) {
+        if (!shooter.Collides(TOP_RC, "vert", 2) && Platform::KeyDown(Key::RIGHT)) {
             shooter.MoveBy({ 0, 1 });
         }
-        else if (!shooter.Collides(TOP_LC, "vert", 2) && GetAsyncKeyState(VK_LEFT) & 0x8000) {
+        else if (!shooter.Collides(TOP_LC, "vert", 2) && Platform::KeyDown(Key::LEFT)) {
             shooter.MoveBy({ 0, -1 });
         }
-        else if (counter % 6 == 0 && GetAsyncKeyState(VK_RETURN) & 0x8000) {
-            auto elms = shooter.GetElements();
-            bullets.push_back(new Point(elms[0]->thisState.coord, "PINK", "", '|'));
+        else if (loaded && Platform::KeyDown(Key::ENTER)) {
+            Coord tip = shooter.thisState.coord + Coord(0, 2);
+            Entity bullet = world.Create();
+            world.position.Add(bullet, tip);
+            world.velocity.Add(bullet, { -1, 0 });
+            world.sprite.Add(bullet, shots.New(tip, "PINK", "", '|'));
+            world.damage.Add(bullet, 1);
+            world.timer.Add(bullet, { 4 });
+            loaded = false;
         }
+    });
 
+    // one shot per 6 ticks at most
+    sched.Every(6, [&]() { loaded = true; });
 
-        if (!bullets.empty() && counter % 4 == 0)
-        {
-            for (auto bullet : bullets)
-            {
-                bullet->MoveBy({ -1, 0 });
-                Coord bulletCoord = bullet->thisState.coord;
 
-                if (bulletCoord.ROW < FISH_TOP.ROW)
-                {
-                    if (bulletCoord.ROW <= boulder.thisState.coord.ROW + boulder.height || bulletCoord.ROW <= TOP_LC.ROW)
-                    {
-                        bullet->Clear();
-                        bullets.erase(std::remove(bullets.begin(), bullets.end(), bullet), bullets.end());
-                        delete bullet;
-                    }
-                }
-                else
-                {
-                    FISH_TOP = BOT_LC;
-                    for (auto fish : fishes)
-                    {
-                        if (!fish->IsAlive()) continue;
-
-                        if (bulletCoord == fish->getBottom() + Coord(1, 0))
-                        {
-                            if (fish->DealHit())
-                            {
-                                fishes.erase(std::remove(fishes.begin(), fishes.end(), fish), fishes.end());
-                                delete fish;
-                            }
-
-                            bullet->Clear();
-                            bullets.erase(std::remove(bullets.begin(), bullets.end(), bullet), bullets.end());
-                            delete bullet;
-                        }
-                        if (fish->IsAlive() && fish->vertex.ROW < FISH_TOP.ROW) {
-                            FISH_TOP = fish->vertex;
-                        }
-                    }
-                }
-            }
-        }
+    auto removeBullet = [&](const Entity& bullet)
+    {
+        Point *shot = static_cast<Point *>(*world.sprite.Get(bullet));
+        shot->Clear();
+        shots.Delete(shot);
+        world.Destroy(bullet);
+    };
 
-        if (counter % 8 == 0)
+    // A hit takes its points at once and flashes the fish through every color, one
+    // every 5 ticks, as a task of its own so the other tasks keep their ticks. When
+    // the flash is over the fish dies if it has no points left, or is given its own
+    // color back; one hit while it flashes only takes the points.
+    auto hitFish = [&](const Entity& fish, int damage)
+    {
+        *world.hitPoints.Get(fish) -= damage;
+
+        if (std::find(flashing.begin(), flashing.end(), fish) != flashing.end()) return;
+        flashing.push_back(fish);
+
+        Sprite *body = static_cast<Sprite *>(*world.sprite.Get(fish));
+        ColorId own = body->thisState.fgColor, next = 1;
+        body->ChangeColor(next++);
+
+        auto flash = std::make_shared<int>();
+        *flash = sched.Every(5, [&, fish, body, own, next, flash]() mutable
         {
-            if (!boulder.Reframe(boulderDir) || boulder.Collides(FISH_TOP, "horz"))
-            {
-                boulderDir = { -boulderDir.ROW, boulderDir.COL };
+            if (next < colors.size()) {
+                body->ChangeColor(next++);
+                return;
             }
-            if (boulder.Collides(SHOOT_TIP, "horz")) {
-                shooter.Clear();
-                boulder.Clear();
-                poop1.Clear();
-                poop2.Clear();
-                break;
-            }
-        }
 
-        for (auto fish : fishes)
-        {
-            if (counter % fish->freq == 0) {
-                fish->Move();
+            sched.Cancel(*flash);
+            flashing.erase(std::find(flashing.begin(), flashing.end(), fish));
+
+            if (*world.hitPoints.Get(fish) > 0) {
+                body->ChangeColor(own);
+                return;
             }
-        }
 
-        if (++counter == 145) {
-            if (stinkLevel > 2)
-            {
-                MicroSleep(2 s);
-                return -1;
+            body->Clear(false);
+            world.Destroy(fish);
+            bodies.Delete(body);
+
+            // the boulder bounces off the topmost fish left
+            FISH_TOP = BOT_LC;
+            for (int i = 0; i < world.hitPoints.Size(); i++) {
+                Coord other = *world.position.Get(world.hitPoints.Owner(i));
+                if (other.ROW < FISH_TOP.ROW) FISH_TOP = other;
             }
+        });
+    };
+
+    sched.Every(1, [&]()
+    {
+        world.Step();
+
+        world.ForEach([&](const Entity& fish) {
+            if (world.Due(fish) && world.hitPoints.Get(fish)) TurnFish(world, fish);
+        });
 
-            poop1.MoveBy({ -1, 0 });
-            poop1.Reframe({ 1, 0 });
+        world.Move();
+        world.Render();
 
-            poop2.MoveBy({ -1, 0 });
-            poop2.Reframe({ 1, 0 });
-            
-            if (stinkLevel == 0 && poop1.height >= TANK_H / 3)
+        // a bullet can remove itself as it goes, the walk still reaches the rest
+        world.ForEach([&](const Entity& entity)
+        {
+            if (!world.Due(entity)) return;
+
+            if (entity == boulderId)
             {
-                stinkLevel++;
-                poop1.ChangeColor("", "POOP");
-                poop2.ChangeColor("", "POOP");
+                Coord& boulderDir = *world.velocity.Get(boulderId);
+
+                if (!boulder.Reframe(boulderDir) || boulder.Collides(FISH_TOP, "horz"))
+                {
+                    boulderDir = { -boulderDir.ROW, boulderDir.COL };
+                }
+                if (boulder.Collides(SHOOT_TIP, "horz")) {
+                    shooter.Clear();
+                    boulder.Clear();
+                    poop1.Clear();
+                    poop2.Clear();
+                    sched.Stop();
+                }
+                return;
             }
-            else if (poop1.height >= TANK_H / 2)
+
+            if (!world.damage.Get(entity)) return;
+
+            Entity bullet = entity;
+            Coord bulletCoord = *world.position.Get(bullet);
+
+            if (bulletCoord.ROW < FISH_TOP.ROW)
             {
-                poop1.ChangePattern(wormDance ? "~ " : " ~");
-                poop2.ChangePattern(wormDance ? "~ " : " ~");
-                wormDance = !wormDance;
+                if (bulletCoord.ROW <= boulder.thisState.coord.ROW + boulder.height || bulletCoord.ROW <= TOP_LC.ROW) {
+                    removeBullet(bullet);
+                }
+                return;
             }
 
-            if (poop1.height >= TANK_H - 2)
+            hits.clear();
+            world.Near(bulletCoord - Coord(1, 0), bulletCoord - Coord(1, 0), hits);
+
+            for (const Entity& fish : hits)
             {
-                stinkLevel++;
+                if (!world.hitPoints.Get(fish) || bulletCoord != FishBottom(world, fish) + Coord(1, 0)) continue;
 
-                boulder.ChangeColor("", "OCHRE");
-                shooter.ChangeColor("POOP");
+                hitFish(fish, *world.damage.Get(bullet));
+                removeBullet(bullet);
+                break;
             }
+        });
+    });
+
+
+    sched.Every(144, [&]()
+    {
+        if (stinkLevel > 2)
+        {
+            stunk = true;
+            sched.Stop();
+            return;
+        }
+
+        poop1.MoveBy({ -1, 0 });
+        poop1.Reframe({ 1, 0 });
+
+        poop2.MoveBy({ -1, 0 });
+        poop2.Reframe({ 1, 0 });
+        
+        if (stinkLevel == 0 && poop1.height >= TANK_H / 3)
+        {
+            stinkLevel++;
+            poop1.ChangeColor("", "POOP");
+            poop2.ChangeColor("", "POOP");
+        }
+        else if (poop1.height >= TANK_H / 2)
+        {
+            poop1.ChangePattern(wormDance ? "~ " : " ~");
+            poop2.ChangePattern(wormDance ? "~ " : " ~");
+            wormDance = !wormDance;
+        }
+
+        if (poop1.height >= TANK_H - 2)
+        {
+            stinkLevel++;
 
-            counter = 1;
+            boulder.ChangeColor("", "OCHRE");
+            shooter.ChangeColor("POOP");
         }
+    });
+
 
+    sched.Run();
+    sched.Report(std::cerr);
 
-        Pause(6 ms);
+    if (stunk)
+    {
+        MicroSleep(2 s);
+        return -1;
     }
 
 
@@ -311,19 +398,36 @@ int main()
 }
 
 
+// the tanks and the walls below them
+void DrawScenery()
+{
+    Screen::SetLayer(Layer::SCENERY);
+
+    MakeTank(TOP_LC);
+    MakeTank(TOP_RC - Coord(0, TANK_W - 1));
+
+    Screen::SetColor("WHITE", Screen::SCREEN_BG);
+    Figure::Join(TOP_LC + Coord(TANK_H, 0), BOT_LC, '+');
+    Figure::Join(TOP_RC + Coord(TANK_H, 0), BOT_RC, '+');
+    Figure::Join(BOT_LC, BOT_RC, '=');
+
+    Screen::SetLayer(Layer::ACTORS);
+}
+
+
 void MakeTank(const Coord& where)
 {
     Screen::AtCoord(where);
     Screen::SetColor(TANK_COLOR);
 
 
-    CanvasDraw(Fmt("' ' '_'_%d ' '", TANK_W - 2));
+    CanvasDraw<"' ' '_'_%d ' '">(TANK_W - 2);
 
     for (int i = 2; i < TANK_H; i++) {
-        CanvasDraw(Fmt("d l%d '|' ' '_%d '|'", TANK_W, TANK_W - 2));
+        CanvasDraw<"d l%d '|' ' '_%d '|'">(TANK_W, TANK_W - 2);
     }
 
-    CanvasDraw(Fmt("d l%d '*' '-'_%d '*'", TANK_W, TANK_W - 2));
+    CanvasDraw<"d l%d '*' '-'_%d '*'">(TANK_W, TANK_W - 2);
 }
 
 
@@ -0,0 +1,192 @@
+#pragma once
+#include "style.h"
+#include <functional>
+#include <deque>
+
+
+
+// Drives a game at a fixed simulation tick. Periodic tasks live in a timer wheel
+// slotted by the tick they are due on; every tick runs the due tasks, presents the
+// frame and sleeps until the next tick's deadline, so the work time is taken out of
+// the wait instead of added to it. Ticks that end past their deadline are counted.
+class Scheduler
+{
+    private:
+        static const int WHEEL = 256;
+
+        class Timer
+        {
+            public:
+                std::function<void()> task;
+                long long due = 0;
+                int period = 1;
+                bool active = false;
+        };
+
+        std::deque<Timer> timers;   // a deque so a task registering timers can't move its own
+        std::vector<int> wheel[WHEEL];
+        std::vector<int> firing, freeIds;
+        long long deadline = 0;
+        bool running = false;
+        bool ticking = false;   // firing is being walked, so it can't be reallocated
+
+
+        void Slot(int id)
+        {
+            wheel[timers[id].due % WHEEL].push_back(id);
+        }
+
+
+        // its last wheel entry is gone, so the id can be handed out again
+        void Release(int id)
+        {
+            timers[id].task = nullptr;
+            freeIds.push_back(id);
+        }
+
+
+        // a timer is in one slot at a time, so with room for all of them ticks never allocate
+        void Reserve()
+        {
+            if (firing.capacity() >= timers.size())
+                return;
+
+            firing.reserve(2 * timers.size());
+
+            for (std::vector<int>& slot : wheel)
+                slot.reserve(2 * timers.size());
+        }
+
+
+        void RunTick()
+        {
+            firing.swap(wheel[tick % WHEEL]);
+            ticking = true;
+
+            for (int id : firing)
+            {
+                Timer& timer = timers[id];
+
+                if (!timer.active)
+                {
+                    Release(id);
+                    continue;
+                }
+
+                if (timer.due != tick)
+                {
+                    Slot(id);   // due on a later turn of the wheel
+                    continue;
+                }
+
+                timer.task();
+
+                if (timer.active)   // unless the task cancelled itself
+                {
+                    timer.due += timer.period;
+                    Slot(id);
+                }
+                else
+                    Release(id);
+            }
+
+            firing.clear();
+            ticking = false;
+            Reserve();   // for the timers the tasks registered
+            tick++;
+        }
+
+
+    public:
+        long long tickMicros;
+        long long tick = 0;
+        int maxCatchUp = 8;   // ticks to run back to back after an overrun before giving up on them
+
+        // deadline report
+        long long missed = 0, worstLate = 0;
+
+
+        Scheduler(long long tickMicros)
+        {
+            this->tickMicros = tickMicros;
+        }
+
+
+        // calls task every period ticks, the first time period ticks from now
+        int Every(int period, std::function<void()> task)
+        {
+            int id;
+
+            if (freeIds.empty())
+            {
+                id = timers.size();
+                timers.emplace_back();
+
+                if (!ticking)
+                    Reserve();
+            }
+            else
+            {
+                id = freeIds.back();
+                freeIds.pop_back();
+            }
+
+            Timer& timer = timers[id];
+            timer.task = std::move(task);
+            timer.period = std::max(period, 1);
+            timer.due = tick + timer.period;
+            timer.active = true;
+
+            Slot(id);
+            return id;
+        }
+
+
+        void Cancel(int id)
+        {
+            // the task itself is dropped once the wheel lets go of it, as it may be running now
+            if (id >= 0 && id < (int) timers.size())
+                timers[id].active = false;
+        }
+
+
+        void Stop()
+        {
+            running = false;
+        }
+
+
+        // runs ticks until a task calls Stop()
+        void Run()
+        {
+            running = true;
+            deadline = Platform::NowMicros();
+
+            while (running)
+            {
+                RunTick();
+                Screen::Present();
+
+                deadline += tickMicros;
+                long long late = Platform::NowMicros() - deadline;
+
+                if (late > 0)
+                {
+                    missed++;
+                    worstLate = std::max(worstLate, late);
+
+                    if (late > maxCatchUp * tickMicros)
+                        deadline = Platform::NowMicros();
+                }
+                else
+                    SleepUntil(deadline);
+            }
+        }
+
+
+        void Report(std::ostream& out)
+        {
+            out << tick << " ticks of " << tickMicros << " us, "
+                << missed << " missed deadlines, worst " << worstLate << " us late\n";
+        }
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include "style.h"
+
+
+
+// Names an item of a SlotMap. It stays valid until that item is removed, and a
+// stale one never finds the item that later takes the same slot.
+class SlotHandle
+{
+    public:
+        int slot = -1;
+        uint32_t generation = 0;
+
+
+        bool operator==(const SlotHandle& other) const
+        {
+            return slot == other.slot && generation == other.generation;
+        }
+
+
+        bool operator!=(const SlotHandle& other) const
+        {
+            return !(*this == other);
+        }
+};
+
+
+template <>
+struct std::hash<SlotHandle>
+{
+    size_t operator()(const SlotHandle& handle) const
+    {
+        return std::hash<uint64_t>()((uint64_t) handle.generation << 32 | (uint32_t) handle.slot);
+    }
+};
+
+
+// Items packed in one vector, in no set order, and reached by handle. Removing one
+// moves the last item into its place. While ForEach is walking, removed items are
+// skipped and only taken out once it is done, so its body can remove any item,
+// itself included. Items inserted by the body are not walked, and inserting may
+// move the items, so the body shouldn't touch its own item after inserting.
+template <typename T>
+class SlotMap
+{
+    private:
+        class Slot
+        {
+            public:
+                int dense = -1;   // where its item is in items
+                uint32_t generation = 0;
+                bool live = false;
+        };
+
+        std::vector<T> items;
+        std::vector<int> slotOf;   // of each item
+        std::vector<Slot> slots;
+        std::vector<int> freeSlots, removed;
+        int walking = 0;
+
+
+        void Erase(int slot)
+        {
+            int dense = slots[slot].dense, last = items.size() - 1;
+
+            if (dense != last)
+            {
+                items[dense] = std::move(items[last]);
+                slotOf[dense] = slotOf[last];
+                slots[slotOf[dense]].dense = dense;
+            }
+
+            items.pop_back();
+            slotOf.pop_back();
+            slots[slot].dense = -1;
+            freeSlots.push_back(slot);
+        }
+
+
+    public:
+        SlotHandle Insert(T item)
+        {
+            int slot;
+
+            if (freeSlots.empty())
+            {
+                slot = slots.size();
+                slots.emplace_back();
+            }
+            else
+            {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+            }
+
+            slots[slot].dense = items.size();
+            slots[slot].live = true;
+            items.push_back(std::move(item));
+            slotOf.push_back(slot);
+
+            return SlotHandle { slot, slots[slot].generation };
+        }
+
+
+        // nullptr once the item is removed
+        T* Get(const SlotHandle& handle)
+        {
+            if (handle.slot < 0 || handle.slot >= (int) slots.size())
+                return nullptr;
+
+            Slot& slot = slots[handle.slot];
+
+            if (!slot.live || slot.generation != handle.generation)
+                return nullptr;
+
+            return &items[slot.dense];
+        }
+
+
+        // false if it was already removed
+        bool Remove(const SlotHandle& handle)
+        {
+            if (!Get(handle))
+                return false;
+
+            slots[handle.slot].live = false;
+            slots[handle.slot].generation++;
+
+            if (walking)
+                removed.push_back(handle.slot);
+            else
+                Erase(handle.slot);
+
+            return true;
+        }
+
+
+        // calls body(handle, item) for every item there was when it started and is still there
+        template <typename Body>
+        void ForEach(Body body)
+        {
+            int count = items.size();
+            walking++;
+
+            for (int i = 0; i < count; i++)
+            {
+                int slot = slotOf[i];
+
+                if (slots[slot].live)
+                    body(SlotHandle { slot, slots[slot].generation }, items[i]);
+            }
+
+            if (--walking == 0)
+            {
+                for (int slot : removed)
+                    Erase(slot);
+
+                removed.clear();
+            }
+        }
+
+
+        int Size() const
+        {
+            return items.size() - removed.size();
+        }
+};
@@ -0,0 +1,220 @@
+#pragma once
+#include "style.h"
+
+
+
+// A uniform grid over the screen for finding what is near what without trying
+// every pair. Items are registered with a box (rows and columns, inclusive) and
+// listed in every bucket the box touches; moving an item only touches the buckets
+// when its box crosses into other ones. Boxes off the screen go in the edge buckets.
+// An item is anything hashable that names a thing, a pointer or an entity.
+template <typename Item>
+class SpatialGrid
+{
+    private:
+        class Entry
+        {
+            public:
+                Item item = Item();
+                Coord topLeft, botRight;
+                long long stamp = 0;   // the last query that found it
+        };
+
+        int cellSize, rows, cols;
+        std::vector<std::vector<int>> buckets;
+        std::vector<Entry> entries;
+        std::vector<int> freeIds;
+        std::unordered_map<Item, int> ids;
+        long long stamp = 0;
+
+
+        // the buckets a box covers, clamped to the grid
+        void Span(const Coord& topLeft, const Coord& botRight, int& top, int& left, int& bot, int& right) const
+        {
+            top   = std::clamp((topLeft.ROW - 1) / cellSize, 0, rows - 1);
+            left  = std::clamp((topLeft.COL - 1) / cellSize, 0, cols - 1);
+            bot   = std::clamp((botRight.ROW - 1) / cellSize, 0, rows - 1);
+            right = std::clamp((botRight.COL - 1) / cellSize, 0, cols - 1);
+        }
+
+
+        void Link(int id)
+        {
+            int top, left, bot, right;
+            Span(entries[id].topLeft, entries[id].botRight, top, left, bot, right);
+
+            for (int row = top; row <= bot; row++)
+                for (int col = left; col <= right; col++)
+                    buckets[row * cols + col].push_back(id);
+        }
+
+
+        void Unlink(int id)
+        {
+            int top, left, bot, right;
+            Span(entries[id].topLeft, entries[id].botRight, top, left, bot, right);
+
+            for (int row = top; row <= bot; row++)
+            {
+                for (int col = left; col <= right; col++)
+                {
+                    std::vector<int>& bucket = buckets[row * cols + col];
+                    auto at = std::find(bucket.begin(), bucket.end(), id);
+
+                    *at = bucket.back();
+                    bucket.pop_back();
+                }
+            }
+        }
+
+
+        static bool Overlap(const Entry& a, const Entry& b)
+        {
+            return a.topLeft.ROW <= b.botRight.ROW && b.topLeft.ROW <= a.botRight.ROW &&
+                   a.topLeft.COL <= b.botRight.COL && b.topLeft.COL <= a.botRight.COL;
+        }
+
+
+    public:
+        SpatialGrid(int cellSize = 8)
+        {
+            this->cellSize = cellSize;
+            rows = (Screen::HEIGHT + cellSize - 1) / cellSize;
+            cols = (Screen::WIDTH + cellSize - 1) / cellSize;
+            buckets.resize(rows * cols);
+        }
+
+
+        void Insert(const Item& item, const Coord& topLeft, const Coord& botRight)
+        {
+            if (ids.count(item))
+            {
+                Move(item, topLeft, botRight);
+                return;
+            }
+
+            int id;
+
+            if (freeIds.empty())
+            {
+                id = entries.size();
+                entries.emplace_back();
+            }
+            else
+            {
+                id = freeIds.back();
+                freeIds.pop_back();
+            }
+
+            ids[item] = id;
+            entries[id].item = item;
+            entries[id].topLeft = topLeft;
+            entries[id].botRight = botRight;
+            Link(id);
+        }
+
+
+        void Move(const Item& item, const Coord& topLeft, const Coord& botRight)
+        {
+            auto found = ids.find(item);
+            if (found == ids.end())
+                return;
+
+            Entry& entry = entries[found->second];
+            int oldSpan[4], newSpan[4];
+
+            Span(entry.topLeft, entry.botRight, oldSpan[0], oldSpan[1], oldSpan[2], oldSpan[3]);
+            Span(topLeft, botRight, newSpan[0], newSpan[1], newSpan[2], newSpan[3]);
+
+            if (std::equal(oldSpan, oldSpan + 4, newSpan))
+            {
+                entry.topLeft = topLeft;
+                entry.botRight = botRight;
+                return;
+            }
+
+            Unlink(found->second);
+            entry.topLeft = topLeft;
+            entry.botRight = botRight;
+            Link(found->second);
+        }
+
+
+        void Remove(const Item& item)
+        {
+            auto found = ids.find(item);
+            if (found == ids.end())
+                return;
+
+            Unlink(found->second);
+            entries[found->second].item = Item();
+            freeIds.push_back(found->second);
+            ids.erase(found);
+        }
+
+
+        // the items whose boxes overlap the box from topLeft to botRight, each once
+        void Query(const Coord& topLeft, const Coord& botRight, std::vector<Item>& found)
+        {
+            Entry query;
+            query.topLeft = topLeft;
+            query.botRight = botRight;
+
+            int top, left, bot, right;
+            Span(topLeft, botRight, top, left, bot, right);
+            stamp++;
+
+            for (int row = top; row <= bot; row++)
+            {
+                for (int col = left; col <= right; col++)
+                {
+                    for (int id : buckets[row * cols + col])
+                    {
+                        Entry& entry = entries[id];
+
+                        if (entry.stamp != stamp && Overlap(entry, query))
+                        {
+                            entry.stamp = stamp;
+                            found.push_back(entry.item);
+                        }
+                    }
+                }
+            }
+        }
+
+
+        // every pair of items whose boxes overlap, each pair once
+        void Pairs(std::vector<std::pair<Item, Item>>& found)
+        {
+            for (int bucket = 0; bucket < rows * cols; bucket++)
+            {
+                const std::vector<int>& ids = buckets[bucket];
+
+                for (size_t i = 0; i < ids.size(); i++)
+                {
+                    for (size_t j = i + 1; j < ids.size(); j++)
+                    {
+                        const Entry& a = entries[ids[i]];
+                        const Entry& b = entries[ids[j]];
+
+                        if (!Overlap(a, b))
+                            continue;
+
+                        // a pair sharing several buckets is reported from the one holding the corner of their overlap
+                        int top, left, bot, right;
+                        Span(Coord(std::max(a.topLeft.ROW, b.topLeft.ROW), std::max(a.topLeft.COL, b.topLeft.COL)),
+                             Coord(1, 1), top, left, bot, right);
+
+                        if (top * cols + left == bucket)
+                            found.emplace_back(a.item, b.item);
+                    }
+                }
+            }
+        }
+
+
+        int Size() const
+        {
+            return ids.size();
+        }
+};
@@ -1,7 +1,4 @@
-#include <stdarg.h>
-#include <windows.h>
-// set the path accordingly
-#include "C:\Users\User\Desktop\VSCode\Cpp\Modules\style.h"
+#include "style.h"
 
 
 std::map<std::string, char> cursorCtrls = {
@@ -12,253 +9,240 @@ std::map<std::string, char> cursorCtrls = {
 };
 
 
-std::map<std::string, std::string> colors = {
-    { "RED", "255;0;0" },
-    { "GREEN", "0;255;0" },
-    { "BLUE", "0;0;255" },
-    { "BLACK", "0;0;0" },
-    { "WHITE", "255;255;255" },
-    { "YELLOW", "255;255;0" },
-    { "PURPLE", "205;65;225" },
-    { "PINK", "255;0;125" },
-    { "CYAN", "0;255;255" },
-    { "ROSE", "150;0;75" },
-    { "EMERALD", "0;200;105" },
-    { "OCHRE", "204;119;34" },
-    { "POOP", "101;67;33" },
-    { "SKY", "50;155;255" },
-    { "LAVENDER", "180;100;255" },
-    { "BATHROOM", "100;100;255" },
-    { "GRAY", "32;32;32" },
-    { "CONSOLE", "12;12;12" }
-};
+// indexed by ColorId
+std::vector<ColorSpec> colors = [] {
+    std::vector<ColorSpec> table;
+    for (const auto& entry : PALETTE_TABLE)
+        table.emplace_back(entry[0], entry[1]);
+    return table;
+}();
 
 
-std::map<std::string, std::string> styles = {
-    { "HIDE", "?25l" },
-    { "UHIDE", "?25h" },
-    { "BOLD", "1m" },
-    { "UBOLD", "22m" },
-    { "ITALIC", "3m" },
-    { "UITALIC", "23m" },
-    { "LINE", "4m" },
-    { "ULINE", "24m" },
-    { "STRIKE", "9m" },
-    { "USTRIKE", "29m" }
-};
+// indexed by StyleId
+std::vector<StyleSpec> styles = [] {
+    std::vector<StyleSpec> table;
+    for (const auto& entry : STYLE_TABLE)
+        table.emplace_back(entry[0], entry[1]);
+    return table;
+}();
 
 
 std::vector<State> Screen::LIFOSaves;
 std::map<std::string, State> Screen::mapSaves;
-std::string Screen::SCREEN_BG = "CONSOLE";
+ColorId Screen::SCREEN_BG = Palette::CONSOLE;
+int Screen::WIDTH = 188;
+int Screen::HEIGHT = 50;
+int Screen::resizes = 0;
+std::vector<Cell> Screen::backBuff(Screen::WIDTH * Screen::HEIGHT);
+std::vector<Cell> Screen::frontBuff(Screen::WIDTH * Screen::HEIGHT);
+std::vector<Cell> Screen::layers[Layer::COUNT] = {
+    std::vector<Cell>(Screen::WIDTH * Screen::HEIGHT, Cell('\0')),
+    std::vector<Cell>(Screen::WIDTH * Screen::HEIGHT, Cell('\0')),
+    std::vector<Cell>(Screen::WIDTH * Screen::HEIGHT, Cell('\0')),
+    std::vector<Cell>(Screen::WIDTH * Screen::HEIGHT, Cell('\0'))
+};
+int Screen::topLayer = 0;
+State Screen::termState;
+int Screen::dirtyTop = Screen::HEIGHT + 1;
+int Screen::dirtyBot = 0;
+int Screen::lpad = 0;
+bool Screen::lineStart = true;
+FrameStats Screen::frame;
+FrameStats Screen::history[Screen::HISTORY];
+long long Screen::historyCount = 0;
 
 
 int wait = 0;
-OutBuffer outBuff(120);
-State stateNow(Coord(1, 1), "WHITE", Screen::SCREEN_BG);
+OutBuffer outBuff(1 << 16);   // room for a typical full repaint
+State stateNow(Coord(1, 1), Palette::WHITE, Screen::SCREEN_BG);
+
+
+ColorId ColorID(const std::string& name)
+{
+    for (ColorId id = 1; id < colors.size(); id++)
+        if (colors[id].name == name)
+            return id;
+
+    return Palette::NONE;
+}
+
+
+StyleId StyleID(const std::string& name)
+{
+    for (StyleId id = 1; id < styles.size(); id++)
+        if (styles[id].name == name)
+            return id;
+
+    return 0;
+}
 
 
 void Pause(int x)
 {
-    outBuff.flush();
+    Screen::Present();
     MicroSleep(x);
 }
 
 
-void MicroSleep(long long microseconds)
+// how late the OS wakes us from a short sleep, with some margin
+static long long CalibrateSleep()
 {
-    LARGE_INTEGER frequency;
-    LARGE_INTEGER start, end;
-    QueryPerformanceFrequency(&frequency);
-    double ticksPerMicrosecond = static_cast<double>(frequency.QuadPart) / 1000000.0;
-    QueryPerformanceCounter(&start);
-
-    while (true) {
-        QueryPerformanceCounter(&end);
-        double elapsedMicroseconds = static_cast<double>(end.QuadPart - start.QuadPart) / ticksPerMicrosecond;
+    long long worst = 0;
 
-        if (elapsedMicroseconds >= microseconds) {
-            break;
-        }
+    for (int i = 0; i < 8; i++)
+    {
+        long long deadline = Platform::NowMicros() + 1000;
+        Platform::SleepCoarse(deadline);
+        worst = std::max(worst, Platform::NowMicros() - deadline);
     }
+
+    return worst + worst / 4 + 50;
 }
 
 
-//bring in a token system instead
-void CanvasDraw(const std::string& cmd, bool flush, bool is_line_start)
+// measured lazily: at static initialization it would cost every program the sleeps, and
+// the platform's clock might not be set up yet
+long long sleepSlack = -1;
+
+
+void SleepUntil(long long deadline)
 {
-    int len = cmd.length();
+    if (sleepSlack < 0)
+        sleepSlack = CalibrateSleep();
 
-    outBuff.IsLineStart(is_line_start);
+    if (deadline - sleepSlack > Platform::NowMicros())
+        Platform::SleepCoarse(deadline - sleepSlack);
+
+    // spin only through the final slice the OS can't be trusted with
+    while (Platform::NowMicros() < deadline) { }
+}
+
+
+void MicroSleep(long long microseconds)
+{
+    SleepUntil(Platform::NowMicros() + microseconds);
+}
+
+
+std::unordered_map<std::string, CanvasProgram, CanvasProgram::ViewHash, std::equal_to<>> CanvasProgram::cache;
+
+
+CanvasProgram::CanvasProgram(std::string_view cmd) : text(cmd)
+{
+    int len = cmd.length(), args = 0;
 
     for (int i = 0; i < len; )
     {
-        int n = 0;
-        char c = cmd[i];
-        
-        if (c == ' ')
+        if (cmd[i] == ' ')
         {
             i++;
             continue;
         }
-        if (c == '\'')
-        {
-            std::string buff = "";
-
-            while (cmd[++i] != '\'')
-                buff += cmd[i];
-
-            if (i < len && cmd[++i] == '_')
-                while (std::isdigit(cmd[++i]))
-                    n = n * 10 + cmd[i] - 48;
-            else
-                n = 1;
-            
-            while (n--)
-                outBuff << buff;
-        }
-        else if (c == 't')
-        {
-            while (++i < len && std::isdigit(cmd[i]))
-                n = n * 10 + cmd[i] - 48;
-
-            if (flush)
-                outBuff.flush();
-            
-            MicroSleep(n * 1000);
-        }
-        else if (isupper(c))
-        {
-            std::string color = std::string(1, c);
 
-            while (++i < len && isupper(cmd[i]))
-                color += cmd[i];
+        CanvasOp op;
+        i = CanvasParse(cmd.data(), len, i, op, args);
 
-
-            std::string fbc = "38";
-            if (i < len && cmd[i] == '*')
-            {
-                fbc = "48";
-                i++;
-            }
-            outBuff << "\033[" << fbc << ";2;" << colors.find(color)->second << "m";
-        }
-        else if (c == '-')   //reset styles
+        // %d only means something in the compile-time CanvasDraw
+        if (i < 0 || args)
         {
-            outBuff << "\033[0m";
-            i++;
-        }
-        else if (c == 'H')
-        {
-            outBuff << "\033[H";
-            i++;
+            valid = false;
+            ops.clear();
+            break;
         }
-        else if (c == 'b')
-        {
-            while (++i < len && std::isdigit(cmd[i]))
-                n = n * 10 + cmd[i] - 48;
 
-            outBuff << "\033[" << n << "D" << std::string(n, ' ');
-        }
-        else if (c == '(')
-        {
-            int coord[] = { 0, 0 };
-            for (int j = 0; j < 2; j++)
-            {
-                while (++i < len && std::isdigit(cmd[i]))
-                    coord[j] = coord[j] * 10 + cmd[i] - 48;
-            }
-
-            outBuff << "\033[" << coord[0] << ";" << coord[1] << "H";
-            i++;
-        }
-        else if (c == '[')
-        {
-            std::string spec = "";
+        ops.push_back(op);
+    }
+}
 
-            while (cmd[++i] != ']')
-                spec += cmd[i];
 
-            outBuff << "\033[" << styles[spec];
-            i++;
-        }
-        else
+void CanvasRun(const CanvasOp *ops, int count, const char *cmd, const int *args, bool flush)
+{
+    for (const CanvasOp *op = ops; op < ops + count; op++)
+    {
+        int n = (op->nArg >= 0) ? args[op->nArg] : op->n;
+        int m = (op->mArg >= 0) ? args[op->mArg] : op->m;
+
+        switch (op->code)
         {
-            if (cmd[i+1] == '*')
-            {
-                n = 300;
-                i++;
-            }
-            else
-            {
-                while (++i < len && std::isdigit(cmd[i]))
-                    n = n * 10 + cmd[i] - 48;
-            }
-            
-            if (!n) n = 1;
-
-            int direction = c == 'u' ? Dir::UP :
-                            c == 'd' ? Dir::DOWN :
-                            c == 'r' ? Dir::RIGHT :
-                            c == 'l' ? Dir::LEFT :
-                            Dir::NONE;
-
-            Screen::MoveCursor(direction, n);
+            case CanvasOp::TEXT:
+                while (n-- > 0)
+                    Screen::Print(cmd + op->at, op->length);
+                break;
+
+            case CanvasOp::SLEEP:
+                if (flush)
+                    Screen::Present();
+                MicroSleep(n * 1000);
+                break;
+
+            case CanvasOp::FG:
+                Screen::SetColor(op->id);
+                break;
+
+            case CanvasOp::BG:
+                Screen::SetColor(Palette::NONE, op->id);
+                break;
+
+            case CanvasOp::RESET:
+                Screen::ResetStyle();
+                break;
+
+            case CanvasOp::HOME:
+                Screen::AtCoord();
+                break;
+
+            case CanvasOp::ERASE:
+                Screen::MoveCursor(Dir::LEFT, n);
+                Screen::Print(' ', n);
+                break;
+
+            case CanvasOp::GOTO:
+                Screen::AtCoord({ n, m });
+                break;
+
+            case CanvasOp::STYLE:
+                Screen::SetStyle(op->id);
+                break;
+
+            case CanvasOp::MOVE:
+                Screen::MoveCursor(op->id, n ? n : 1);
+                break;
         }
 
-
         if (flush)
-            outBuff.flush();
+            Screen::Present();
         if (wait) MicroSleep(wait * 1000);
     }
 }
 
 
-std::string Fmt(char *cmd, ...)
+const CanvasProgram& CanvasProgram::Compiled(std::string_view cmd)
 {
-    std::string str = "";
+    static CanvasProgram uncached("");
+    auto found = cache.find(cmd);
 
-    va_list args;
-    va_start(args, cmd);
+    if (found != cache.end())
+        return found->second;
 
-    for (int i = 0; cmd[i]; i++)
+    if (cache.size() >= CACHE_SIZE)
     {
-        char c = cmd[i];
-
-        if (c == '%')
-        {
-            c = cmd[++i];
-
-            switch (c)
-            {
-                case 'd': {
-                    str += std::to_string(va_arg(args, int));
-                    break;
-                }
-
-                case 'c': {
-                    str += c;
-                    break;
-                }
-
-                case 's': {
-                    char *ptr = va_arg(args, char *);
-
-                    for (int j = 0; ptr[j]; j++)
-                        str += ptr[j];
-                }
-            }
-        }
-        else
-            str += c;
+        uncached = CanvasProgram(cmd);
+        return uncached;
     }
 
-    return str;
+    return cache.emplace(cmd, CanvasProgram(cmd)).first->second;
+}
+
+
+void CanvasDraw(std::string_view cmd, bool flush, bool is_line_start)
+{
+    Screen::IsLineStart(is_line_start);
+    CanvasProgram::Compiled(cmd).Run(flush);
 }
 
 
 void disp_coord(Coord coord)
 {
-    outBuff.flush();
+    Screen::Present();
     std::cout << coord.ROW << ", " << coord.COL << std::endl;
 }
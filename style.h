@@ -1,9 +1,16 @@
-#include <windows.h>
+#pragma once
+#include "platform.h"
 #include <map>
 #include <string>
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <string_view>
 #include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
 
 
 
@@ -77,13 +84,164 @@ class Coord
 };
 
 
+typedef unsigned char ColorId;   // index into colors
+typedef unsigned char StyleId;   // index into styles
+
+
+// ids of the built-in colors, in the order of the colors table in style.cpp
+namespace Palette
+{
+    enum Name : ColorId {
+        NONE = 0,
+        RED, GREEN, BLUE, BLACK, WHITE, YELLOW, PURPLE, PINK, CYAN,
+        ROSE, EMERALD, OCHRE, POOP, SKY, LAVENDER, BATHROOM, GRAY, CONSOLE
+    };
+}
+
+
+// the screen's layers, bottom first: what is drawn on one covers the ones below it,
+// and clearing it shows them again
+namespace Layer
+{
+    enum Name {
+        BACKGROUND = 0,
+        SCENERY,
+        ACTORS,
+        HUD,
+        COUNT
+    };
+}
+
+
+// name and rgb of each built-in color, in Palette order
+constexpr const char *PALETTE_TABLE[][2] = {
+    { "", "" },
+    { "RED", "255;0;0" },
+    { "GREEN", "0;255;0" },
+    { "BLUE", "0;0;255" },
+    { "BLACK", "0;0;0" },
+    { "WHITE", "255;255;255" },
+    { "YELLOW", "255;255;0" },
+    { "PURPLE", "205;65;225" },
+    { "PINK", "255;0;125" },
+    { "CYAN", "0;255;255" },
+    { "ROSE", "150;0;75" },
+    { "EMERALD", "0;200;105" },
+    { "OCHRE", "204;119;34" },
+    { "POOP", "101;67;33" },
+    { "SKY", "50;155;255" },
+    { "LAVENDER", "180;100;255" },
+    { "BATHROOM", "100;100;255" },
+    { "GRAY", "32;32;32" },
+    { "CONSOLE", "12;12;12" }
+};
+
+
+// name and SGR parameters of each style, indexed by StyleId
+constexpr const char *STYLE_TABLE[][2] = {
+    { "", "" },
+    { "HIDE", "?25l" },
+    { "UHIDE", "?25h" },
+    { "BOLD", "1m" },
+    { "UBOLD", "22m" },
+    { "ITALIC", "3m" },
+    { "UITALIC", "23m" },
+    { "LINE", "4m" },
+    { "ULINE", "24m" },
+    { "STRIKE", "9m" },
+    { "USTRIKE", "29m" }
+};
+
+
+// index of the entry of table named by name[0, length), 0 when there is none
+template <size_t N>
+constexpr int TableIndex(const char *const (&table)[N][2], const char *name, int length)
+{
+    for (size_t id = 1; id < N; id++)
+    {
+        const char *entry = table[id][0];
+        int i = 0;
+
+        while (i < length && entry[i] == name[i])
+            i++;
+
+        if (i == length && entry[i] == '\0')
+            return id;
+    }
+
+    return 0;
+}
+
+
+// a palette entry, with its escape sequences built once
+class ColorSpec
+{
+    public:
+        std::string name, fgSGR, bgSGR;
+
+        ColorSpec(const std::string& name, const std::string& rgb)
+        {
+            this->name = name;
+
+            if (rgb != "")
+            {
+                fgSGR = "\033[38;2;" + rgb + "m";
+                bgSGR = "\033[48;2;" + rgb + "m";
+            }
+        }
+};
+
+
+class StyleSpec
+{
+    public:
+        std::string name, SGR;
+        bool cursorOnly;   // HIDE/UHIDE act on the cursor, not on cells
+
+        StyleSpec(const std::string& name, const std::string& code)
+        {
+            this->name = name;
+            SGR = (code != "") ? "\033[" + code : "";
+            cursorOnly = name == "HIDE" || name == "UHIDE";
+        }
+};
+
+
+extern std::vector<ColorSpec> colors;
+extern std::vector<StyleSpec> styles;
+
+// name lookups, 0 when unknown or empty
+ColorId ColorID(const std::string& name);
+StyleId StyleID(const std::string& name);
+
+
+// a color given either by id or by name, so the drawing API keeps taking names
+class Color
+{
+    public:
+        ColorId id;
+
+        Color(ColorId id = Palette::NONE) : id(id) { }
+        Color(Palette::Name id) : id(id) { }
+        Color(const char *name) : id(ColorID(name)) { }
+        Color(const std::string& name) : id(ColorID(name)) { }
+
+        operator ColorId() const
+        {
+            return id;
+        }
+};
+
+
 class State
 {
     public:
         Coord coord;
-        std::string fgColor, bgColor, style;
+        ColorId fgColor, bgColor;
+        StyleId style;
+        int layer = Layer::ACTORS;   // the one drawing goes to
 
-        State(const Coord& coord = { -1, -1 }, const std::string& fgColor = "", const std::string& bgColor = "", const std::string& style = "")
+        State(const Coord& coord = { -1, -1 }, Color fgColor = Palette::NONE, Color bgColor = Palette::NONE, StyleId style = 0)
         {
             this->coord = coord;
             this->fgColor = fgColor;
@@ -92,15 +250,6 @@ class State
         }
 
 
-        State(const State& state)
-        {
-            coord = state.coord;
-            fgColor = state.fgColor;
-            bgColor = state.bgColor;
-            style = state.style;
-        }
-
-
         bool operator==(State other)
         {
             return coord == other.coord && fgColor == other.fgColor && bgColor == other.bgColor;
@@ -114,114 +263,158 @@ class State
 };
 
 
+static_assert(std::is_trivially_copyable<State>::value, "State is copied on every save/restore");
+
 extern State stateNow;
 
 
+// one character slot of the screen, as Screen's frame buffers see it
+class Cell
+{
+    public:
+        char glyph;
+        ColorId fgColor, bgColor;
+        StyleId style;
+
+        Cell(char glyph = ' ', ColorId fgColor = Palette::NONE, ColorId bgColor = Palette::NONE, StyleId style = 0)
+        {
+            this->glyph = glyph;
+            this->fgColor = fgColor;
+            this->bgColor = bgColor;
+            this->style = style;
+        }
+
+
+        // a layer's cells are empty where nothing is drawn on it
+        bool IsEmpty() const
+        {
+            return glyph == '\0';
+        }
+
+
+        // a plain blank looks the same whatever its foreground is
+        bool operator==(const Cell& other) const
+        {
+            return glyph == other.glyph && bgColor == other.bgColor && style == other.style &&
+                   ((glyph == ' ' && style == 0) || fgColor == other.fgColor);
+        }
+
+
+        bool operator!=(const Cell& other) const
+        {
+            return !(*this == other);
+        }
+};
+
+
+// writes value in decimal so that it ends just before end, returning where it starts
+inline char *FormatInt(char *end, long long value)
+{
+    unsigned long long magnitude = (value < 0) ? 0ull - value : value;
+
+    do {
+        *--end = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0)
+        *--end = '-';
+
+    return end;
+}
+
+
+// Bytes bound for the terminal. The buffer is allocated once and handed to the
+// OS in a single write per flush, so a frame costs one syscall and no allocations.
 class OutBuffer
 {
     private:
-        std::string buffer;
-        bool line_start = true;
+        std::vector<char> buffer;
+        int length = 0;
 
 
     public:
-        int lpad = 0, bufferSize;
-        bool modifyStateNow = true;
+        int bufferSize;
+        long long bytes = 0, flushes = 0;   // sent to the terminal so far
         
         OutBuffer(int bufferSize)
         {
-            this->bufferSize = bufferSize;
+            Resize(bufferSize);
         }
 
 
-        bool IsLineStart(bool is_it)
+        void Resize(int bufferSize)
         {
-            line_start = is_it;
+            flush();
+            this->bufferSize = bufferSize;
+            buffer.resize(bufferSize);
         }
 
 
-        OutBuffer& operator<<(const std::string& other)
+        OutBuffer& Write(const char *bytes, int count)
         {
-            if (lpad)
+            if (length + count > bufferSize)
             {
-                std::string padding = std::string(lpad, ' ');
+                flush();
 
-                if (line_start)
+                if (count > bufferSize)
                 {
-                    buffer += padding;
-                    line_start = false;
-                    if (modifyStateNow)
-                        stateNow.coord.COL += lpad;
+                    this->bytes += count;
+                    flushes++;
+                    Platform::Write(bytes, count);
+                    return *this;
                 }
+            }
 
-                if (other.find('\n') != std::string::npos)
-                {
-                    for (int i = 0; i < other.length(); i++)
-                    {
-                        buffer += other[i];
-                        if (modifyStateNow)
-                            stateNow.coord.COL++;
+            memcpy(buffer.data() + length, bytes, count);
+            length += count;
 
-                        if (other[i] == '\n')
-                        {
-                            buffer += padding;
-                            if (modifyStateNow)
-                            {
-                                stateNow.coord.ROW++;
-                                stateNow.coord.COL = lpad + 1;
-                            }
-                        }
-                    }
-                }
-                else
-                {
-                    buffer += other;
-                    if (modifyStateNow)
-                        stateNow.coord.COL += other.length();
-                }
-            }
-            else
-            {
-                buffer += other;
+            return *this;
+        }
 
-                int newlCount = std::count(other.begin(), other.end(), '\n');
 
-                if (modifyStateNow)
-                {
-                    if (newlCount == 0)
-                    {
-                        stateNow.coord.COL += other.length();
-                    }
-                    else
-                    {
-                        stateNow.coord.ROW += newlCount;
-                        stateNow.coord.COL += other.length() - other.rfind('\n') - 1;
-                    }
-                }
-            }
+        OutBuffer& operator<<(const std::string& other)
+        {
+            return Write(other.data(), other.length());
+        }
 
-            if (buffer.length() > bufferSize) flush();
-            
-            return *this;
+
+        OutBuffer& operator<<(const char *other)
+        {
+            return Write(other, strlen(other));
         }
 
 
         OutBuffer& operator<<(int other)
         {
-            return *this << std::to_string(other);
+            char digits[12];
+            char *end = digits + sizeof digits;
+            char *at = FormatInt(end, other);
+
+            return Write(at, end - at);
         }
 
 
         OutBuffer& operator<<(char other)
         {
-            return *this << std::string(1, other);
+            if (length == bufferSize)
+                flush();
+
+            buffer[length++] = other;
+            return *this;
         }
 
 
         void flush()
         {
-            std::cout << buffer << std::flush;
-            buffer = "";
+            if (length)
+            {
+                bytes += length;
+                flushes++;
+            }
+
+            Platform::Write(buffer.data(), length);
+            length = 0;
         }
 
 
@@ -245,17 +438,193 @@ namespace Dir
 }
 
 
-void CanvasDraw(const std::string& cmd, bool flush = false, bool is_line_start = false);
-std::string Fmt(char *cmd, ...);
+void CanvasDraw(std::string_view cmd, bool flush = false, bool is_line_start = false);
 void MicroSleep(long long microseconds);
 
+// Sleeps until the monotonic clock (Platform::NowMicros) reaches deadline: the OS sleep covers
+// all but the last sleepSlack microseconds, measured by the first call, which are spun.
+void SleepUntil(long long deadline);
+extern long long sleepSlack;
+
 extern std::map<std::string, char> cursorCtrls;
-extern std::map<std::string, std::string> colors;
-extern std::map<std::string, std::string> styles;
 extern OutBuffer outBuff;
 extern int wait;
 
 
+void FmtError(const char *why);   // never defined; a format check that reaches it fails to compile
+
+
+template <typename T>
+constexpr char FmtSpec()
+{
+    using Arg = std::remove_cvref_t<T>;
+
+    if constexpr (std::is_same_v<Arg, char>)
+        return 'c';
+    else if constexpr (std::is_integral_v<Arg> || std::is_enum_v<Arg>)
+        return 'd';
+    else if constexpr (std::is_convertible_v<const Arg&, std::string_view>)
+        return 's';
+    else
+        return '?';
+}
+
+
+// A format string checked against the argument types at compile time:
+// %d takes an integer, %c a char, %s a string, and %% is a literal '%'.
+template <typename... Args>
+class FmtString
+{
+    public:
+        const char *chars;
+
+        consteval FmtString(const char *chars) : chars(chars)
+        {
+            const char specs[] = { FmtSpec<Args>()..., '\0' };
+            int arg = 0;
+
+            for (int i = 0; chars[i]; i++)
+            {
+                if (chars[i] != '%')
+                    continue;
+
+                char spec = chars[++i];
+
+                if (spec == '%')
+                    continue;
+                if (spec != 'd' && spec != 'c' && spec != 's')
+                    FmtError("unknown % specifier");
+                if (arg == sizeof...(Args))
+                    FmtError("more % specifiers than arguments");
+                if (spec != specs[arg])
+                    FmtError("argument does not match its % specifier");
+
+                arg++;
+            }
+
+            if (arg != sizeof...(Args))
+                FmtError("more arguments than % specifiers");
+        }
+};
+
+
+// a caller's char array as a Fmt target; counts what didn't fit so the full length is known
+class FmtBuffer
+{
+    public:
+        char *at, *end;
+        int length = 0;
+
+        FmtBuffer(char *buffer, int size) : at(buffer), end(buffer + size) { }
+
+        void Write(const char *bytes, int count)
+        {
+            int fits = std::min<long>(count, end - at);
+
+            if (fits > 0)
+            {
+                memcpy(at, bytes, fits);
+                at += fits;
+            }
+            length += count;
+        }
+};
+
+
+// copies the literal part of fmt to out and returns the character after the next '%' specifier
+template <typename Sink>
+const char *FmtLiteral(Sink& out, const char *fmt)
+{
+    while (*fmt)
+    {
+        const char *percent = strchr(fmt, '%');
+
+        if (!percent)
+        {
+            out.Write(fmt, strlen(fmt));
+            return fmt + strlen(fmt);
+        }
+
+        out.Write(fmt, percent - fmt);
+
+        if (percent[1] != '%')
+            return percent + 2;
+
+        out.Write("%", 1);
+        fmt = percent + 2;
+    }
+
+    return fmt;
+}
+
+
+template <typename Sink, typename Arg>
+void FmtArg(Sink& out, const Arg& arg)
+{
+    if constexpr (FmtSpec<Arg>() == 'c')
+        out.Write(&arg, 1);
+    else if constexpr (FmtSpec<Arg>() == 'd')
+    {
+        char digits[24];
+        char *end = digits + sizeof digits;
+        char *start = FormatInt(end, (long long) arg);
+
+        out.Write(start, end - start);
+    }
+    else
+    {
+        std::string_view string = arg;
+        out.Write(string.data(), string.length());
+    }
+}
+
+
+template <typename Sink, typename... Args>
+void FmtTo(Sink& out, const char *fmt, const Args&... args)
+{
+    ((fmt = FmtLiteral(out, fmt), FmtArg(out, args)), ...);
+    FmtLiteral(out, fmt);
+}
+
+
+// Formats into buffer, always NUL-terminated and cut short if it doesn't fit.
+// Returns the length the whole text needs, like snprintf; with size 0 nothing is
+// written and buffer may be null.
+template <typename... Args>
+int Fmt(char *buffer, int size, FmtString<std::type_identity_t<Args>...> fmt, const Args&... args)
+{
+    FmtBuffer out(buffer, std::max(size - 1, 0));
+
+    FmtTo(out, fmt.chars, args...);
+
+    if (size > 0)
+        *out.at = '\0';
+
+    return out.length;
+}
+
+
+// formats straight into out
+template <typename... Args>
+void Fmt(OutBuffer& out, FmtString<std::type_identity_t<Args>...> fmt, const Args&... args)
+{
+    FmtTo(out, fmt.chars, args...);
+}
+
+
+// what went into one frame, from one Present() to the next
+class FrameStats
+{
+    public:
+        long long bytes = 0, flushes = 0;
+        long long cursorMoves = 0;                      // planned by PlanCursor
+        long long colorChanges = 0, styleChanges = 0;   // SGRs sent
+        long long saves = 0, restores = 0;              // SaveState/RetrieveState calls
+        long long printed = 0;                          // cells drawn, sent or not
+        long long sent = 0;                             // cells that differed and were sent
+};
+
+
 class Screen
 {
     public:
@@ -264,72 +633,92 @@ class Screen
 
 
     
-        static const int WIDTH = 188;
-        static const int HEIGHT = 50;
-        static std::string SCREEN_BG;
+        // the terminal's size, followed by FitTerminal()
+        static int WIDTH, HEIGHT;
+        static ColorId SCREEN_BG;
+
+        // how many times the terminal was resized, for a game to notice and lay itself out again
+        static int resizes;
+
+
+        // backBuff is what the figures have drawn, frontBuff is what the terminal shows.
+        // Drawing only touches backBuff; Present() sends the difference.
+        static std::vector<Cell> backBuff, frontBuff;
+        static State termState;
+
+        // What has been drawn on each layer, empty cells where nothing is. backBuff shows
+        // each cell of the topmost layer that has one there, so clearing a figure brings
+        // back the scenery under it from its layer rather than having it drawn again.
+        // Layers above topLayer have nothing on them.
+        static std::vector<Cell> layers[Layer::COUNT];
+        static int topLayer;
+
+        static int dirtyTop, dirtyBot;
+        static int lpad;
+        static bool lineStart;
+
+        // frame is being counted, history holds the last HISTORY frames, historyCount of them ever
+        static const int HISTORY = 1024;
+        static FrameStats frame, history[HISTORY];
+        static long long historyCount;
 
     
-        static void SetColor(const std::string& fgColor, const std::string& bgColor = "")
+        static void SetColor(Color fgColor, Color bgColor = Palette::NONE)
         {
-            outBuff.modifyStateNow = false;
-
-            if (fgColor != "" && fgColor != stateNow.fgColor)
-            {
-                outBuff << "\033[38;2;" << colors[fgColor] << "m";
+            if (fgColor != Palette::NONE)
                 stateNow.fgColor = fgColor;
-            }
             
-            if (bgColor != "" && bgColor != stateNow.bgColor)
-            {
-                outBuff << "\033[48;2;" << colors[bgColor] << "m";
+            if (bgColor != Palette::NONE)
                 stateNow.bgColor = bgColor;
-            }
-
-            outBuff.modifyStateNow = true;
         }
 
 
-        static void SetStyle(const std::string& style)
+        static void SetLayer(int layer)
         {
-            outBuff.modifyStateNow = false;
+            stateNow.layer = layer;
+        }
 
-            if (style != "")
-            {
-                outBuff << "\033[" << styles[style];
 
-                if (style != "HIDE" && style != "UHIDE")
-                    stateNow.style = style;
-            }
+        static void SetStyle(StyleId style)
+        {
+            if (styles[style].cursorOnly)
+                outBuff << styles[style].SGR;
+            else if (style != 0)
+                stateNow.style = style;
+        }
+
 
-            outBuff.modifyStateNow = true;
+        static void SetStyle(const std::string& style)
+        {
+            SetStyle(StyleID(style));
         }
 
 
-        static void MoveCursor(int where, int n = 1)
+        static void ResetStyle()
         {
-            outBuff.modifyStateNow = false;
+            stateNow.fgColor = Palette::WHITE;
+            stateNow.bgColor = SCREEN_BG;
+            stateNow.style = 0;
+        }
 
-            outBuff << "\033[" << n;
 
+        static void MoveCursor(int where, int n = 1)
+        {
             switch (where)
             {
                 case Dir::UP:
-                    outBuff << cursorCtrls["UP"];
                     stateNow.coord.ROW -= n;
                     break;
                 
                 case Dir::DOWN:
-                    outBuff << cursorCtrls["DOWN"];
                     stateNow.coord.ROW += n;
                     break;
                 
                 case Dir::RIGHT:
-                    outBuff << cursorCtrls["RIGHT"];
                     stateNow.coord.COL += n;
                     break;
                 
                 case Dir::LEFT:
-                    outBuff << cursorCtrls["LEFT"];
                     stateNow.coord.COL -= n;
                     break;
 
@@ -353,8 +742,6 @@ class Screen
                     MoveCursor(Dir::DOWN);
                     break;
             }
-
-            outBuff.modifyStateNow = true;
         }
 
 
@@ -363,446 +750,2045 @@ class Screen
             if (!actual)
                 return stateNow.coord;
 
-            HANDLE hConsoleOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-            CONSOLE_SCREEN_BUFFER_INFO csbi = { };
-            GetConsoleScreenBufferInfo(hConsoleOutput, &csbi);
-            COORD res = csbi.dwCursorPosition;
+            Coord actualCoord;
+            if (!Platform::CursorPos(actualCoord.ROW, actualCoord.COL))
+                return stateNow.coord;
 
-            return Coord(res.X + 1, res.Y + 1);
+            return actualCoord;
         }
 
 
         static void AtCoord(const Coord& dest = { 1, 1 })
         {
-            outBuff.modifyStateNow = false;
-
-            outBuff << "\033[" << dest.ROW << ";" << dest.COL << "H";
             stateNow.coord = dest;
-
-            outBuff.modifyStateNow = true;
         }
 
 
-        static void Paint(const std::string& color)
+        // nullptr when the point is off screen
+        static Cell* CellAt(const Coord& point)
         {
-            Screen::AtCoord();
-            Screen::SetColor("", color);
-            Screen::SCREEN_BG = color;
-            
-            for (int i = 0; i < HEIGHT; i++)
-            {
-                outBuff << std::string(WIDTH, ' ');
-
-                Screen::MoveCursor(Dir::DOWN);
-                Screen::MoveCursor(Dir::LEFT, WIDTH);
-            }
+            if (point.ROW < 1 || point.COL < 1 || point.ROW > HEIGHT || point.COL > WIDTH)
+                return nullptr;
 
-            Screen::AtCoord();
-            outBuff.flush();
+            return &backBuff[(point.ROW - 1) * WIDTH + point.COL - 1];
         }
 
 
-        static void Puts(const Coord& point = { -1, -1 }, const std::string& string = "*", bool getCoord = true, bool getBg = true, bool getFg = false, bool getStyle = false)
+        // true if a layer above layer has a cell at i, an index into the buffers
+        static bool Covered(int i, int layer)
         {
-            bool dontOptimize = !(getCoord || getBg || getFg);
+            for (int above = layer + 1; above <= topLayer; above++)
+                if (!layers[above][i].IsEmpty())
+                    return true;
 
-            if (dontOptimize)
-                Screen::SaveState();
-                
-            if (point.isValid())
-                Screen::AtCoord(point);
+            return false;
+        }
 
-            outBuff << string;
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+        // the topmost cell the layers below layer have at i, a blank of the screen's background if none has one
+        static Cell Beneath(int i, int layer)
+        {
+            for (int below = layer - 1; below >= 0; below--)
+                if (!layers[below][i].IsEmpty())
+                    return layers[below][i];
+
+            return Cell(' ', Palette::NONE, SCREEN_BG);
         }
 
 
-        static void SaveState()
+        // puts cell at i on layer, and on screen unless a layer above covers it
+        static void PutCell(int i, const Cell& cell, int layer)
         {
-            LIFOSaves.push_back(stateNow);
+            layers[layer][i] = cell;
+            topLayer = std::max(topLayer, layer);
+
+            if (!Covered(i, layer))
+                backBuff[i] = cell;
         }
 
 
-        static void SaveState(const std::string& tag, Coord coord = { -1, -1 }, const std::string& fgColor = "", const std::string& bgColor = "", const std::string& style = "")
+        // brings n cells of layer from i on to the screen, straight when no layer above has anything
+        static void Show(int i, int n, int layer)
         {
-            mapSaves[tag] = State((coord.ROW == -1) ? GetCurs() : coord, fgColor, bgColor, style);
+            topLayer = std::max(topLayer, layer);
+
+            if (topLayer == layer)
+                std::copy_n(&layers[layer][i], n, &backBuff[i]);
+            else
+                for (int k = i; k < i + n; k++)
+                    if (!Covered(k, layer))
+                        backBuff[k] = layers[layer][k];
         }
 
 
-        static void RetrieveState(bool getCoord = true, bool getBg = true, bool getFg = false, bool getStyle = false)
+        static void PutCells(int i, const Cell *cells, int n, int layer)
         {
-            if (!LIFOSaves.empty())
+            std::copy_n(cells, n, &layers[layer][i]);
+            Show(i, n, layer);
+        }
+
+
+        // takes the cell at i off layer, showing what lies beneath unless a layer above covers it
+        static void EraseCell(int i, int layer)
+        {
+            layers[layer][i] = Cell('\0');
+
+            if (!Covered(i, layer))
+                backBuff[i] = Beneath(i, layer);
+        }
+
+
+        // takes everything off layer, for what is drawn on it to be drawn again elsewhere
+        static void ClearLayer(int layer)
+        {
+            for (int i = 0; i < HEIGHT * WIDTH; i++)
+                if (!layers[layer][i].IsEmpty())
+                    EraseCell(i, layer);
+
+            dirtyTop = 1;
+            dirtyBot = HEIGHT;
+        }
+
+
+        // puts n cells on the cursor's row and layer, taken from glyphs or all set to fill,
+        // or takes them off it if erase, clipped to the screen
+        static void PutRun(const char *glyphs, char fill, int n, bool erase = false)
+        {
+            Coord& at = stateNow.coord;
+
+            if (at.ROW >= 1 && at.ROW <= HEIGHT)
             {
-                State state = LIFOSaves.back();
-                
-                if (getCoord)
-                    Screen::AtCoord(state.coord);
-                if (getStyle)
-                    Screen::SetStyle(state.style);
+                int first = std::max(at.COL, 1);
+                int last = std::min(at.COL + n - 1, WIDTH);
 
-                if (getFg && getBg)
-                    Screen::SetColor(state.fgColor, state.bgColor);
-                else if (getBg)
-                    Screen::SetColor("", state.bgColor);
-                else if (getFg)
-                    Screen::SetColor(state.fgColor, "");
+                if (first <= last)
+                {
+                    int i = (at.ROW - 1) * WIDTH + first - 1;
+
+                    if (erase)
+                    {
+                        for (int k = i; k <= i + last - first; k++)
+                            EraseCell(k, stateNow.layer);
+                    }
+                    else
+                    {
+                        Cell *cell = &layers[stateNow.layer][i];
+
+                        for (int col = first; col <= last; col++, cell++)
+                            *cell = Cell(glyphs ? glyphs[col - at.COL] : fill, stateNow.fgColor, stateNow.bgColor, stateNow.style);
+
+                        Show(i, last - first + 1, stateNow.layer);
+                    }
+
+                    frame.printed += last - first + 1;
+                    dirtyTop = std::min(dirtyTop, at.ROW);
+                    dirtyBot = std::max(dirtyBot, at.ROW);
+                }
             }
+
+            at.COL += n;
         }
 
 
-        static void RetrieveState(const std::string& tag, bool getCoord = true, bool getBg = true, bool getFg = false, bool getStyle = false)
+        static void PadLine()
         {
-            if (mapSaves.count(tag))
+            if (lineStart)
             {
-                State state = mapSaves[tag];
-                
-                if (getCoord)
-                    Screen::AtCoord(state.coord);
-                if (getStyle)
-                    Screen::SetStyle(state.style);
-
-                if (getFg && getBg)
-                    Screen::SetColor(state.fgColor, state.bgColor);
-                else if (getBg)
-                    Screen::SetColor("", state.bgColor);
-                else if (getFg)
-                    Screen::SetColor(state.fgColor, "");
+                lineStart = false;
+                PutRun(nullptr, ' ', lpad);
             }
         }
 
 
-        static void UpdateState(const State& state)
+        static void NewLine()
         {
-            Screen::AtCoord(state.coord);
-            Screen::SetColor(state.fgColor, state.bgColor);
-            Screen::SetStyle(state.style);
+            stateNow.coord.ROW++;
+            stateNow.coord.COL = 1;
+            lineStart = true;
         }
-};
 
 
-#define ms *1000   //milliseconds to microseconds (for MicroSleep)
-#define s  *1000000
-#define M  *60000000
+        // writes n copies of character at the cursor with the current colors and style
+        static void Print(char character, int n = 1)
+        {
+            if (character == '\n')
+            {
+                while (n-- > 0)
+                    NewLine();
 
-extern void Pause(int x = 1 s);
+                return;
+            }
 
+            PadLine();
+            PutRun(nullptr, character, n);
+        }
 
-class Figure
-{
-    public:
-        State thisState;
+
+        // clears n cells at the cursor off its layer, so that what lies beneath shows
+        static void Erase(int n = 1)
+        {
+            PadLine();
+            PutRun(nullptr, 0, n, true);
+        }
 
 
-        Figure(const Coord& vertex = { -1, -1 }, const std::string& fgColor = "", const std::string& bgColor = "")
+        static void Print(const std::string& string)
         {
-            Coord nowCursor = Screen::GetCurs();
+            Print(string.data(), string.length());
+        }
 
-            thisState.coord.ROW = (vertex.ROW != -1) ? vertex.ROW : nowCursor.ROW;
-            thisState.coord.COL = (vertex.COL != -1) ? vertex.COL : nowCursor.COL;
-            thisState.fgColor = (fgColor == "") ? "WHITE" : fgColor;
-            thisState.bgColor = (bgColor == "") ? Screen::SCREEN_BG : bgColor;
+
+        static void Print(const char *string, int length)
+        {
+            const char *at = string, *end = at + length;
+
+            while (at < end)
+            {
+                const char *newline = (const char *) memchr(at, '\n', end - at);
+                const char *runEnd = newline ? newline : end;
+
+                PadLine();
+                PutRun(at, 0, runEnd - at);
+
+                if (!newline)
+                    break;
+
+                NewLine();
+                at = newline + 1;
+            }
         }
 
 
-        static void Join(const Coord& point1, const Coord& point2, char character = '*')
+        static void IsLineStart(bool is_it)
         {
-            Coord delta = point2 - point1;
+            lineStart = is_it;
+        }
 
-            Screen::SaveState();
-            Screen::AtCoord(point1);
 
-            outBuff << character;
+        static int Digits(int n)
+        {
+            int count = 1;
 
-            if (delta.ROW == 0)
+            while (n >= 10)
             {
-                for (int n = delta.COL; n--; )
-                    outBuff << character;
+                n /= 10;
+                count++;
             }
-            else if (delta.COL == 0)
+
+            return count;
+        }
+
+
+        // ESC [ n final, with n left out when it is 1
+        static int Csi(int n, char final, bool emit)
+        {
+            if (emit)
             {
-                for (int n = delta.ROW; n--; )
-                {
-                    Screen::MoveCursor(Dir::DOWN);
-                    Screen::MoveCursor(Dir::LEFT);
-                    outBuff << character;
-                }
+                outBuff << "\033[";
+                if (n != 1)
+                    outBuff << n;
+                outBuff << final;
             }
-            else if (delta.ROW == delta.COL)
+
+            return (n == 1) ? 3 : 3 + Digits(n);
+        }
+
+
+        // true if the cells [from, to) of row can be sent again as the terminal shows them
+        static bool CanReprint(int row, int from, int to)
+        {
+            for (int col = from; col < to; col++)
             {
-                for (int n = delta.ROW; n--; )
-                {
-                    Screen::MoveCursor(Dir::DOWN);
-                    Screen::MoveCursor(Dir::RIGHT);
-                    outBuff << character;
-                }
+                const Cell& cell = frontBuff[(row - 1) * WIDTH + col - 1];
+
+                if (cell.bgColor != termState.bgColor || cell.style != termState.style)
+                    return false;
+                if (!(cell.glyph == ' ' && cell.style == 0) && cell.fgColor != termState.fgColor)
+                    return false;
             }
 
-            Screen::RetrieveState();
+            return true;
         }
 
 
-        virtual void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) { };
-
+        // cheapest way along a row: re-printing the cells in between, CUF, backspaces or CUB
+        static int Along(int row, int from, int to, bool emit)
+        {
+            int n = std::abs(to - from);
 
-        virtual void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) { };
+            if (n == 0)
+                return 0;
 
+            if (to > from)
+            {
+                if (n < Csi(n, 'C', false) && CanReprint(row, from, to))
+                {
+                    for (int col = from; emit && col < to; col++)
+                        outBuff << frontBuff[(row - 1) * WIDTH + col - 1].glyph;
 
-        virtual void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) { };
+                    return n;
+                }
 
+                return Csi(n, 'C', emit);
+            }
 
-        virtual void MoveBy(const Coord& diff, bool getCoord = true, bool getBg = false, bool getFg = false)
-        {
-            MoveTo(thisState.coord + diff, getCoord, getBg, getFg);
-        }
+            if (n <= Csi(n, 'D', false))
+            {
+                for (int i = 0; emit && i < n; i++)
+                    outBuff << '\b';
 
+                return n;
+            }
 
-        virtual Coord Next(bool reset = false) { }
+            return Csi(n, 'D', emit);
+        }
 
 
-        virtual void ChangeColor(const std::string& fgColor = "", const std::string& bgColor = "", bool optimize = false)
+        // cost of one way of taking the terminal cursor to dest:
+        // 0 absolute CUP, 1 CUU/CUD then along the row, 2 CR then CUU/CUD then along, 3 CR LF per row then along
+        static int Travel(const Coord& dest, int way, bool emit)
         {
-            if (fgColor != "")
-                thisState.fgColor = fgColor;
-            if (bgColor != "")
-                thisState.bgColor = bgColor;
-            
-            if (!optimize)
-                Screen::SaveState();
+            const Coord& from = termState.coord;
+            int rows = dest.ROW - from.ROW;
+            int cost = 0;
 
-            Draw();
+            switch (way)
+            {
+                case 0:
+                    if (emit)
+                    {
+                        outBuff << "\033[";
+                        if (dest.ROW != 1 || dest.COL != 1)
+                            outBuff << dest.ROW;
+                        if (dest.COL != 1)
+                            outBuff << ';' << dest.COL;
+                        outBuff << 'H';
+                    }
 
-            if (!optimize)
-                Screen::RetrieveState();
+                    if (dest.ROW == 1 && dest.COL == 1)
+                        return 3;
+                    return 3 + Digits(dest.ROW) + ((dest.COL != 1) ? 1 + Digits(dest.COL) : 0);
+
+                case 1:
+                    if (rows)
+                        cost += Csi(std::abs(rows), (rows > 0) ? 'B' : 'A', emit);
+                    return cost + Along(dest.ROW, from.COL, dest.COL, emit);
+
+                case 2:
+                    if (emit)
+                        outBuff << '\r';
+                    if (rows)
+                        cost += Csi(std::abs(rows), (rows > 0) ? 'B' : 'A', emit);
+                    return 1 + cost + Along(dest.ROW, 1, dest.COL, emit);
+
+                case 3:
+                    // \r\n lands on column 1 whether or not the tty turns \n into \r\n
+                    for (int i = 0; emit && i < rows; i++)
+                        outBuff << "\r\n";
+                    return 2 * rows + Along(dest.ROW, 1, dest.COL, emit);
+            }
+
+            return 0;
         }
 
 
-        virtual int Collides(const Coord& QPoint, const std::string& lineType, int dist = 1)  //lineType = horz, vert
+        static void PlanCursor(const Coord& dest)
         {
-            int res = 0;
-            bool notFound[] = { true, true, true, true };  //UP, DOWN, RIGHT, LEFT
+            int way = 0, best = Travel(dest, 0, false);
 
-            if (lineType == "horz" || lineType == "all")
+            if (termState.coord.isValid())
             {
-                Coord thisPt;
-
-                while ( (thisPt = Next()).isValid() )
+                for (int other = 1; other <= 3; other++)
                 {
-                    int diff = thisPt.ROW - QPoint.ROW;
+                    if (other == 3 && dest.ROW <= termState.coord.ROW)
+                        continue;
 
-                    if (abs(diff) <= dist)
+                    int cost = Travel(dest, other, false);
+
+                    if (cost < best)
                     {
-                        if (lineType == "all")
-                        {
-                            if (diff < 0 && notFound[0])
-                            {
-                                res += Dir::UP;
-                                notFound[0] = false;
-                            }
-                            else if (diff > 0 && notFound[1])
-                            {
-                                res += Dir::DOWN;
-                                notFound[1] = false;
-                            }
-                        }
-                        else
-                            return (diff > 0) ? Dir::DOWN : Dir::UP;
+                        best = cost;
+                        way = other;
                     }
                 }
             }
-            
-            if (lineType == "vert" || lineType == "all")
+
+            Travel(dest, way, true);
+            termState.coord = dest;
+            frame.cursorMoves++;
+        }
+
+
+        // Resizes the buffers keeping what was drawn where both sizes overlap. A terminal
+        // may reflow or scroll what it showed when resized, so it is cleared to SCREEN_BG
+        // and Present() then only has to send the cells that aren't plain background.
+        static void Resize(int rows, int cols)
+        {
+            if (rows == HEIGHT && cols == WIDTH)
+                return;
+
+            auto keep = [&](std::vector<Cell>& buff, const Cell& fill)
             {
-                Coord thisPt;
-                
-                while ( (thisPt = Next()).isValid() )
-                {
-                    int diff = thisPt.COL - QPoint.COL;
+                std::vector<Cell> resized(rows * cols, fill);
 
-                    if (abs(diff) <= dist)
-                    {
-                        if (lineType == "all")
-                        {
-                            if (diff > 0 && notFound[2])
-                            {
-                                res += Dir::RIGHT;
-                                notFound[2] = false;
-                            }
-                            else if (diff < 0 && notFound[3])
-                            {
-                                res += Dir::LEFT;
-                                notFound[3] = false;
-                            }
-                        }
-                        else
-                            return (diff > 0) ? Dir::RIGHT : Dir::LEFT;
-                    }
-                }
-            }
+                for (int row = 0; row < std::min(rows, HEIGHT); row++)
+                    std::copy_n(&buff[row * WIDTH], std::min(cols, WIDTH), &resized[row * cols]);
 
-            return res;
+                buff.swap(resized);
+            };
+
+            keep(backBuff, Cell(' ', Palette::NONE, SCREEN_BG));
+
+            for (std::vector<Cell>& layer : layers)
+                keep(layer, Cell('\0'));
+
+            frontBuff.assign(rows * cols, Cell(' ', Palette::NONE, SCREEN_BG));
+            HEIGHT = rows;
+            WIDTH = cols;
+
+            outBuff << "\033[0m" << colors[SCREEN_BG].bgSGR << "\033[2J";
+            termState = State(Coord(-1, -1), Palette::NONE, SCREEN_BG);
+
+            dirtyTop = 1;
+            dirtyBot = HEIGHT;
+            resizes++;
         }
 
 
-        virtual int Collides(Figure& other, int dist = 1)
+        // picks up the terminal's size at startup and after it is resized
+        static void FitTerminal()
         {
-            int res = 0;
-            bool notFound[] = { true, true, true, true };  //UP, DOWN, RIGHT, LEFT
-            Coord thisPt, otherPt;
+            int rows, cols;
+
+            if (Platform::Resized() && Platform::ScreenSize(rows, cols))
+                Resize(rows, cols);
+        }
+
+
+        // emits only the cells that changed since the last call, then flushes
+        static void Present()
+        {
+            FitTerminal();
 
-            while ( (thisPt = this->Next()).isValid() )
+            for (int row = dirtyTop; row <= dirtyBot; row++)
             {
-                while ( (otherPt = other.Next()).isValid() )
+                for (int col = 1; col <= WIDTH; col++)
                 {
-                    if (thisPt.COL == otherPt.COL)
+                    int i = (row - 1) * WIDTH + col - 1;
+                    const Cell& cell = backBuff[i];
+
+                    if (cell == frontBuff[i])
+                        continue;
+
+                    if (termState.coord != Coord(row, col))
+                        PlanCursor(Coord(row, col));
+
+                    if (cell.style != termState.style)
                     {
-                        int diff = thisPt.ROW - otherPt.ROW;
+                        outBuff << "\033[0m" << styles[cell.style].SGR;
+                        frame.styleChanges++;
 
-                        if (abs(diff) <= dist)
-                        {
-                            if (diff < 0 && notFound[0])
-                            {
-                                res += Dir::UP;
-                                notFound[0] = false;
-                            }
-                            else if (diff > 0 && notFound[1])
-                            {
-                                res += Dir::DOWN;
-                                notFound[1] = false;
-                            }
-                        }
+                        termState.style = cell.style;
+                        termState.fgColor = termState.bgColor = Palette::NONE;
                     }
 
-                    if (thisPt.ROW == otherPt.ROW)
+                    if (cell.bgColor != Palette::NONE && cell.bgColor != termState.bgColor)
                     {
-                        int diff = thisPt.COL - otherPt.COL;
+                        outBuff << colors[cell.bgColor].bgSGR;
+                        termState.bgColor = cell.bgColor;
+                        frame.colorChanges++;
+                    }
 
-                        if (abs(diff) <= dist)
-                        {
-                            if (diff < 0 && notFound[0])
-                            {
-                                res += Dir::UP;
-                                notFound[0] = false;
-                            }
-                            else if (diff > 0 && notFound[1])
-                            {
-                                res += Dir::DOWN;
-                                notFound[1] = false;
-                            }
-                        }
+                    if (cell.fgColor != Palette::NONE && cell.fgColor != termState.fgColor && (cell.glyph != ' ' || cell.style != 0))
+                    {
+                        outBuff << colors[cell.fgColor].fgSGR;
+                        termState.fgColor = cell.fgColor;
+                        frame.colorChanges++;
                     }
+
+                    outBuff << cell.glyph;
+                    frontBuff[i] = cell;
+                    frame.sent++;
+
+                    // writing the last column leaves the cursor in a pending wrap, so don't trust it
+                    termState.coord = (col < WIDTH) ? Coord(row, col + 1) : Coord(-1, -1);
                 }
             }
 
-            return res;
+            dirtyTop = HEIGHT + 1;
+            dirtyBot = 0;
+            outBuff.flush();
+
+            EndFrame();
         }
-};
 
 
+        // files the frame's counts in history and starts the next frame
+        static void EndFrame()
+        {
+            static long long bytesBefore = 0, flushesBefore = 0;
 
-class Point : public Figure
-{
-    private:
-        char pointChar;
-        bool iterEnd = false;
+            frame.bytes = outBuff.bytes - bytesBefore;
+            frame.flushes = outBuff.flushes - flushesBefore;
+            bytesBefore = outBuff.bytes;
+            flushesBefore = outBuff.flushes;
+
+            history[historyCount++ % HISTORY] = frame;
+            frame = FrameStats();
+        }
+
+
+        // ReportStats to stderr as the program ends
+        static void ReportStatsAtExit()
+        {
+            atexit([]() { ReportStats(std::cerr); });
+        }
+
+
+        // averages over the frames in history and a histogram of their sizes in bytes
+        static void ReportStats(std::ostream& out)
+        {
+            int count = std::min(historyCount, (long long) HISTORY);
+            FrameStats sum;
+            int buckets[64] = { };
+
+            if (!count)
+                return;
+
+            for (int i = 0; i < count; i++)
+            {
+                const FrameStats& stats = history[i];
+
+                sum.bytes += stats.bytes;
+                sum.flushes += stats.flushes;
+                sum.cursorMoves += stats.cursorMoves;
+                sum.colorChanges += stats.colorChanges;
+                sum.styleChanges += stats.styleChanges;
+                sum.saves += stats.saves;
+                sum.restores += stats.restores;
+                sum.printed += stats.printed;
+                sum.sent += stats.sent;
+
+                // bucket b holds [2^(b-1), 2^b) bytes, bucket 0 the empty frames
+                int bucket = 0;
+                while (stats.bytes >> bucket)
+                    bucket++;
+                buckets[bucket]++;
+            }
+
+            double frames = count;
+
+            out << "last " << count << " of " << historyCount << " frames, per frame: "
+                << sum.bytes / frames << " bytes, " << sum.flushes / frames << " flushes, "
+                << sum.cursorMoves / frames << " cursor moves, " << sum.colorChanges / frames << " color and "
+                << sum.styleChanges / frames << " style changes, " << sum.saves / frames << " saves, "
+                << sum.restores / frames << " restores, " << sum.printed / frames << " cells printed, "
+                << sum.sent / frames << " sent\n";
+
+            for (int bucket = 0; bucket < 64; bucket++)
+            {
+                if (!buckets[bucket])
+                    continue;
+
+                long long low = bucket ? 1LL << (bucket - 1) : 0;
+                out << "  " << low << (bucket ? "+" : "") << " bytes\t" << buckets[bucket] << " frames\t"
+                    << std::string(std::max(1, 60 * buckets[bucket] / count), '#') << '\n';
+            }
+        }
+
+
+        static void Paint(Color color)
+        {
+            Screen::SetColor(Palette::NONE, color);
+            Screen::SCREEN_BG = color;
+
+            for (Cell& cell : backBuff)
+                cell = Cell(' ', stateNow.fgColor, color);
+
+            // it paints over every layer
+            for (std::vector<Cell>& layer : layers)
+                std::fill(layer.begin(), layer.end(), Cell('\0'));
+
+            topLayer = 0;
+
+            dirtyTop = 1;
+            dirtyBot = HEIGHT;
+
+            Screen::AtCoord();
+            Screen::Present();
+        }
+
+
+        static void Puts(const Coord& point = { -1, -1 }, const std::string& string = "*", bool getCoord = true, bool getBg = true, bool getFg = false, bool getStyle = false)
+        {
+            bool dontOptimize = !(getCoord || getBg || getFg);
+
+            if (dontOptimize)
+                Screen::SaveState();
+                
+            if (point.isValid())
+                Screen::AtCoord(point);
+
+            Screen::Print(string);
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        static void SaveState()
+        {
+            frame.saves++;
+            LIFOSaves.push_back(stateNow);
+        }
+
+
+        static void SaveState(const std::string& tag, Coord coord = { -1, -1 }, Color fgColor = Palette::NONE, Color bgColor = Palette::NONE, const std::string& style = "")
+        {
+            frame.saves++;
+            mapSaves[tag] = State((coord.ROW == -1) ? GetCurs() : coord, fgColor, bgColor, StyleID(style));
+        }
+
+
+        static void RetrieveState(bool getCoord = true, bool getBg = true, bool getFg = false, bool getStyle = false)
+        {
+            frame.restores++;
+
+            if (!LIFOSaves.empty())
+            {
+                State state = LIFOSaves.back();
+                LIFOSaves.pop_back();
+
+                Screen::SetLayer(state.layer);
+                
+                if (getCoord)
+                    Screen::AtCoord(state.coord);
+                if (getStyle)
+                    Screen::SetStyle(state.style);
+
+                if (getFg && getBg)
+                    Screen::SetColor(state.fgColor, state.bgColor);
+                else if (getBg)
+                    Screen::SetColor(Palette::NONE, state.bgColor);
+                else if (getFg)
+                    Screen::SetColor(state.fgColor);
+            }
+        }
+
+
+        static void RetrieveState(const std::string& tag, bool getCoord = true, bool getBg = true, bool getFg = false, bool getStyle = false)
+        {
+            frame.restores++;
+
+            if (mapSaves.count(tag))
+            {
+                State state = mapSaves[tag];
+                
+                if (getCoord)
+                    Screen::AtCoord(state.coord);
+                if (getStyle)
+                    Screen::SetStyle(state.style);
+
+                if (getFg && getBg)
+                    Screen::SetColor(state.fgColor, state.bgColor);
+                else if (getBg)
+                    Screen::SetColor(Palette::NONE, state.bgColor);
+                else if (getFg)
+                    Screen::SetColor(state.fgColor);
+            }
+        }
+
+
+        static void UpdateState(const State& state)
+        {
+            Screen::SetLayer(state.layer);
+            Screen::AtCoord(state.coord);
+            Screen::SetColor(state.fgColor, state.bgColor);
+            Screen::SetStyle(state.style);
+        }
+};
+
+
+#define ms *1000   //milliseconds to microseconds (for MicroSleep)
+#define s  *1000000
+#define M  *60000000
+
+extern void Pause(int x = 1 s);
+
+
+class CanvasOp
+{
+    public:
+        enum Code : unsigned char { TEXT, SLEEP, FG, BG, RESET, HOME, ERASE, GOTO, STYLE, MOVE };
+
+        Code code = TEXT;
+        unsigned char id = 0;   // color, style or direction
+        int n = 0, m = 0;       // repeats, milliseconds, cells or row; column
+        int at = 0, length = 0; // literal run inside the command string
+        signed char nArg = -1, mArg = -1;   // %d arguments that fill n and m at run time
+};
+
+
+constexpr bool IsDigit(char c)
+{
+    return '0' <= c && c <= '9';
+}
+
+
+constexpr bool IsUpper(char c)
+{
+    return 'A' <= c && c <= 'Z';
+}
+
+
+// a number, or %d standing for the next run-time argument
+constexpr int CanvasNumber(const char *cmd, int len, int& i, signed char& arg, int& args)
+{
+    if (i + 1 < len && cmd[i] == '%' && cmd[i + 1] == 'd')
+    {
+        i += 2;
+        arg = args++;
+        return 0;
+    }
+
+    int n = 0;
+    while (i < len && IsDigit(cmd[i]))
+        n = n * 10 + cmd[i++] - '0';
+
+    return n;
+}
+
+
+// Parses the command of a CanvasDraw string that starts at cmd[i] into op.
+// Returns the index just past it, or -1 if the command is malformed: an
+// unterminated quote or bracket, or an unknown color or style name.
+constexpr int CanvasParse(const char *cmd, int len, int i, CanvasOp& op, int& args)
+{
+    char c = cmd[i];
+
+    if (c == '\'')
+    {
+        int close = i + 1;
+        while (close < len && cmd[close] != '\'')
+            close++;
+
+        if (close == len)
+            return -1;
+
+        op.code = CanvasOp::TEXT;
+        op.at = i + 1;
+        op.length = close - i - 1;
+        i = close + 1;
+
+        op.n = 1;
+        if (i < len && cmd[i] == '_')
+        {
+            i++;
+            op.n = CanvasNumber(cmd, len, i, op.nArg, args);
+        }
+    }
+    else if (c == 't')
+    {
+        i++;
+        op.code = CanvasOp::SLEEP;
+        op.n = CanvasNumber(cmd, len, i, op.nArg, args);
+    }
+    else if (IsUpper(c))
+    {
+        int start = i;
+
+        while (i < len && IsUpper(cmd[i]))
+            i++;
+
+        if (i - start == 1 && c == 'H')
+            op.code = CanvasOp::HOME;
+        else
+        {
+            op.code = CanvasOp::FG;
+            op.id = TableIndex(PALETTE_TABLE, cmd + start, i - start);
+
+            if (!op.id)
+                return -1;
+
+            if (i < len && cmd[i] == '*')
+            {
+                op.code = CanvasOp::BG;
+                i++;
+            }
+        }
+    }
+    else if (c == '-')   //reset styles
+    {
+        op.code = CanvasOp::RESET;
+        i++;
+    }
+    else if (c == 'b')
+    {
+        i++;
+        op.code = CanvasOp::ERASE;
+        op.n = CanvasNumber(cmd, len, i, op.nArg, args);
+    }
+    else if (c == '(')
+    {
+        i++;
+        op.code = CanvasOp::GOTO;
+        op.n = CanvasNumber(cmd, len, i, op.nArg, args);
+        if (i < len) i++;   // separator
+        op.m = CanvasNumber(cmd, len, i, op.mArg, args);
+        if (i < len) i++;   // ')'
+    }
+    else if (c == '[')
+    {
+        int close = i + 1;
+        while (close < len && cmd[close] != ']')
+            close++;
+
+        if (close == len)
+            return -1;
+
+        op.code = CanvasOp::STYLE;
+        op.id = TableIndex(STYLE_TABLE, cmd + i + 1, close - i - 1);
+
+        if (!op.id)
+            return -1;
+
+        i = close + 1;
+    }
+    else
+    {
+        i++;
+
+        if (i < len && cmd[i] == '*')
+        {
+            op.n = 300;
+            i++;
+        }
+        else
+            op.n = CanvasNumber(cmd, len, i, op.nArg, args);
+
+        op.code = CanvasOp::MOVE;
+        op.id = c == 'u' ? Dir::UP :
+                c == 'd' ? Dir::DOWN :
+                c == 'r' ? Dir::RIGHT :
+                c == 'l' ? Dir::LEFT :
+                Dir::NONE;
+    }
+
+    return i;
+}
+
+
+// replays ops, taking %d values from args, over the command string they were parsed from
+void CanvasRun(const CanvasOp *ops, int count, const char *cmd, const int *args, bool flush);
+
+
+// A CanvasDraw command string compiled once into a flat list of ops.
+// A malformed command (e.g. an unterminated quote) makes the program invalid, and
+// an invalid program has no ops, so nothing of it runs. The cache keeps the first
+// CACHE_SIZE strings compiled; strings built at run time past those are compiled
+// on each use, so formatting new ones every frame can't grow it without bound.
+class CanvasProgram
+{
+    private:
+        static const size_t CACHE_SIZE = 256;
+
+        // lets the cache be searched with a string_view, so a lookup never builds a std::string
+        class ViewHash
+        {
+            public:
+                using is_transparent = void;
+
+                size_t operator()(std::string_view key) const
+                {
+                    return std::hash<std::string_view>()(key);
+                }
+        };
+
+        static std::unordered_map<std::string, CanvasProgram, ViewHash, std::equal_to<>> cache;
+
+
+    public:
+        std::vector<CanvasOp> ops;
+        std::string text;
+        bool valid = true;
+
+        CanvasProgram(std::string_view cmd);
+
+        void Run(bool flush = false) const
+        {
+            CanvasRun(ops.data(), ops.size(), text.data(), nullptr, flush);
+        }
+
+        // compiles cmd on first use and replays the cached program after that; a program
+        // left out of a full cache lasts only until the next call
+        static const CanvasProgram& Compiled(std::string_view cmd);
+};
+
+
+// a string literal usable as a template argument
+template <size_t N>
+class FixedString
+{
+    public:
+        char chars[N] = { };
+
+        constexpr FixedString(const char (&string)[N])
+        {
+            for (size_t i = 0; i < N; i++)
+                chars[i] = string[i];
+        }
+};
+
+
+// the ops of a literal CanvasDraw string, worked out by the compiler
+template <FixedString cmd>
+class StaticCanvasProgram
+{
+    public:
+        static constexpr int LEN = sizeof cmd.chars - 1;
+
+        CanvasOp ops[LEN ? LEN : 1] = { };   // every command takes at least one character
+        int count = 0, args = 0;
+        bool valid = true;
+
+        constexpr StaticCanvasProgram()
+        {
+            for (int i = 0; i < LEN; )
+            {
+                if (cmd.chars[i] == ' ')
+                {
+                    i++;
+                    continue;
+                }
+
+                i = CanvasParse(cmd.chars, LEN, i, ops[count], args);
+
+                if (i < 0)
+                {
+                    valid = false;
+                    return;
+                }
+
+                count++;
+            }
+        }
+};
+
+
+// CanvasDraw for a literal command string: the string is checked and lowered to ops
+// at compile time, and only its %d values are passed at run time, e.g.
+//     CanvasDraw<"d l%d '|' ' '_%d '|'">(TANK_W, TANK_W - 2);
+template <FixedString cmd, bool flush = false, typename... Ints>
+void CanvasDraw(Ints... values)
+{
+    static constexpr StaticCanvasProgram<cmd> program;
+
+    static_assert(program.valid, "malformed CanvasDraw string");
+    static_assert(program.args == sizeof...(Ints), "CanvasDraw needs one int per %d");
+
+    const int args[sizeof...(Ints) + 1] = { int(values)... };
+
+    Screen::IsLineStart(false);
+    CanvasRun(program.ops, program.count, cmd.chars, args, flush);
+}
+
+
+// The cells a figure covers, as a row of bits per screen row: bit i of a row stands
+// for column topLeft.COL + i. Two masks are overlapped 64 columns at a time by
+// shifting one's words into line with the other's and ANDing them.
+class Mask
+{
+    public:
+        Coord topLeft;
+        int height = 0, width = 0, words = 0;   // words per row
+        std::vector<uint64_t> bits;
+
+
+        Mask(const Coord& topLeft = { 1, 1 }, int height = 0, int width = 0)
+        {
+            this->topLeft = topLeft;
+            this->height = height;
+            this->width = width;
+            words = (width + 63) / 64;
+            bits.assign(height * words, 0);
+        }
+
+
+        // sets n cells from cell on to the right, the ones inside the mask
+        void SetRun(const Coord& cell, int n = 1)
+        {
+            int row = cell.ROW - topLeft.ROW;
+            int first = std::max(cell.COL - topLeft.COL, 0), last = std::min(cell.COL - topLeft.COL + n, width) - 1;
+
+            if (row < 0 || row >= height)
+                return;
+
+            for (int col = first; col <= last; )
+            {
+                int bit = col % 64, count = std::min(64 - bit, last - col + 1);
+                uint64_t run = (count == 64) ? ~0ull : ((1ull << count) - 1) << bit;
+
+                bits[row * words + col / 64] |= run;
+                col += count;
+            }
+        }
+
+
+        bool Test(const Coord& cell) const
+        {
+            int row = cell.ROW - topLeft.ROW, col = cell.COL - topLeft.COL;
+
+            if (row < 0 || row >= height || col < 0 || col >= width)
+                return false;
+
+            return bits[row * words + col / 64] >> (col % 64) & 1;
+        }
+
+
+        // the 64 bits of row from column col on, zeros past the end
+        uint64_t Window(int row, int col) const
+        {
+            const uint64_t *line = &bits[row * words];
+            int word = col / 64, shift = col % 64;
+            uint64_t window = line[word] >> shift;
+
+            if (shift && word + 1 < words)
+                window |= line[word + 1] << (64 - shift);
+
+            return window;
+        }
+
+
+        // true if a cell is set in both, this mask moved by shift
+        bool Overlaps(const Mask& other, const Coord& shift = { 0, 0 }) const
+        {
+            Coord at = topLeft + shift;
+            int top = std::max(at.ROW, other.topLeft.ROW);
+            int bot = std::min(at.ROW + height, other.topLeft.ROW + other.height) - 1;
+            int left = std::max(at.COL, other.topLeft.COL);
+            int right = std::min(at.COL + width, other.topLeft.COL + other.width) - 1;
+
+            for (int row = top; row <= bot; row++)
+            {
+                for (int col = left; col <= right; col += 64)
+                {
+                    int count = std::min(64, right - col + 1);
+                    uint64_t keep = (count == 64) ? ~0ull : (1ull << count) - 1;
+
+                    if (Window(row - at.ROW, col - at.COL) & other.Window(row - other.topLeft.ROW, col - other.topLeft.COL) & keep)
+                        return true;
+                }
+            }
+
+            return false;
+        }
+};
+
+
+class Figure;
+
+
+// The cells of a figure as a range: for (Coord cell : figure.Perimeter()). It is
+// a rectangle, row by row or only its border clockwise from the top left corner,
+// a group's elements one after another, or a packed group's or sprite's cells in order. Walking it changes nothing, so it can
+// be nested, stopped early or walked from several places at once.
+class CellRange
+{
+    public:
+        Coord topLeft;
+        int height = 0, width = 0;
+        bool border = false;
+
+        const std::vector<Figure*> *parts = nullptr;   // a group's elements, which can't be groups themselves
+        bool filledParts = false;
+
+        const int *cellRows = nullptr, *cellCols = nullptr;   // a packed group's cells, cellCount of them, moved by shift
+        int cellCount = 0;
+        Coord shift = { 0, 0 };
+
+
+        CellRange(const Coord& topLeft = { 1, 1 }, int height = 0, int width = 0, bool border = false)
+        {
+            this->topLeft = topLeft;
+            this->height = std::max(height, 0);
+            this->width = std::max(width, 0);
+            this->border = border;
+        }
+
+
+        CellRange(const std::vector<Figure*>& parts, bool filledParts)
+        {
+            this->parts = &parts;
+            this->filledParts = filledParts;
+        }
+
+
+        CellRange(const int *cellRows, const int *cellCols, int cellCount, const Coord& shift = { 0, 0 })
+        {
+            this->cellRows = cellRows;
+            this->cellCols = cellCols;
+            this->cellCount = cellCount;
+            this->shift = shift;
+        }
+
+
+        // of a rectangle or a packed group; the border of a 1x1 rectangle has no cells
+        int Count() const
+        {
+            if (cellRows)
+                return cellCount;
+
+            return border ? std::max(2 * (width + height) - 4, 0) : height * width;
+        }
+
+
+        Coord At(int index) const
+        {
+            if (cellRows)
+                return shift + Coord(cellRows[index], cellCols[index]);
+
+            if (!border)
+                return topLeft + Coord(index / width, index % width);
+
+            if (index < width)
+                return topLeft + Coord(0, index);
+            if (index < width + height - 1)
+                return topLeft + Coord(index - width + 1, width - 1);
+            if (index < 2 * (width - 1) + height)
+                return topLeft + Coord(height - 1, 2 * width + height - index - 3);
+
+            return topLeft + Coord(2 * (width + height) - index - 4, 0);
+        }
+
+
+        class Iterator;
+
+        Iterator begin() const;
+        Iterator end() const;
+};
+
+
+class CellRange::Iterator
+{
+    public:
+        const CellRange *range;
+        int part, index;
+        CellRange piece;   // the element being walked, for a group
+
+        Iterator(const CellRange *range, int part, int index)
+        {
+            this->range = range;
+            this->part = part;
+            this->index = index;
+        }
+
+        // moves on to the next element with cells once this one is done
+        void Settle();
+
+        Coord operator*() const
+        {
+            return range->parts ? piece.At(index) : range->At(index);
+        }
+
+        Iterator& operator++()
+        {
+            index++;
+            if (range->parts)
+                Settle();
+            return *this;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return part != other.part || index != other.index;
+        }
+};
+
+
+inline CellRange::Iterator CellRange::begin() const
+{
+    if (!parts)
+        return Iterator(this, 0, 0);
+
+    Iterator first(this, -1, 0);
+    first.Settle();
+    return first;
+}
+
+
+inline CellRange::Iterator CellRange::end() const
+{
+    return parts ? Iterator(this, parts->size(), 0) : Iterator(this, 0, Count());
+}
+
+
+class Figure
+{
+    public:
+        State thisState;
+
+
+        Figure(const Coord& vertex = { -1, -1 }, Color fgColor = Palette::NONE, Color bgColor = Palette::NONE)
+        {
+            Coord nowCursor = Screen::GetCurs();
+
+            thisState.coord.ROW = (vertex.ROW != -1) ? vertex.ROW : nowCursor.ROW;
+            thisState.coord.COL = (vertex.COL != -1) ? vertex.COL : nowCursor.COL;
+            thisState.fgColor = (fgColor == Palette::NONE) ? ColorId(Palette::WHITE) : fgColor.id;
+            thisState.bgColor = (bgColor == Palette::NONE) ? Screen::SCREEN_BG : bgColor.id;
+            thisState.layer = stateNow.layer;
+        }
+
+
+        virtual ~Figure() { }
+
+
+        static void Join(const Coord& point1, const Coord& point2, char character = '*')
+        {
+            Coord delta = point2 - point1;
+            Coord step = { (delta.ROW > 0) - (delta.ROW < 0), (delta.COL > 0) - (delta.COL < 0) };
+            int length = std::max(std::abs(delta.ROW), std::abs(delta.COL));
+
+            // only straight lines and diagonals, either way, are joined
+            if (delta.ROW != 0 && delta.COL != 0 && std::abs(delta.ROW) != std::abs(delta.COL))
+                length = 0;
+
+            Screen::SaveState();
+
+            for (int n = 0; n <= length; n++)
+            {
+                Screen::AtCoord({ point1.ROW + n * step.ROW, point1.COL + n * step.COL });
+                Screen::Print(character);
+            }
+
+            Screen::RetrieveState();
+        }
+
+
+        virtual void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) { };
+
+
+        virtual void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) { };
+
+
+        virtual void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) { };
+
+
+        virtual void MoveBy(const Coord& diff, bool getCoord = true, bool getBg = false, bool getFg = false)
+        {
+            MoveTo(thisState.coord + diff, getCoord, getBg, getFg);
+        }
+
+
+        // the cells Collides looks at: a block's border, all of any other shape
+        virtual CellRange Perimeter() const { return CellRange(); }
+
+
+        // every cell the figure draws
+        virtual CellRange Filled() const { return Perimeter(); }
+
+
+        // the smallest box holding every cell of Perimeter(), false if it has none
+        virtual bool Bounds(Coord& topLeft, Coord& botRight) { return false; }
+
+
+        // true if every row and column of Bounds() holds a cell of Perimeter() and it runs
+        // through the top row first, left to right, then the rows below: Collides can use the box
+        virtual bool Boxlike() { return true; }
+
+
+        // sets the cells the figure draws in mask
+        virtual void Stamp(Mask& mask)
+        {
+            for (Coord cell : Filled())
+                mask.SetRun(cell);
+        }
+
+
+        // the figure's cells over its bounds, built in scratch unless the figure keeps its own
+        virtual const Mask& GetMask(Mask& scratch)
+        {
+            Coord topLeft, botRight;
+
+            if (Bounds(topLeft, botRight))
+            {
+                scratch = Mask(topLeft, botRight.ROW - topLeft.ROW + 1, botRight.COL - topLeft.COL + 1);
+                Stamp(scratch);
+            }
+
+            return scratch;
+        }
+
+
+        // true if the two figures draw on a common cell, this one moved by shift
+        bool Overlaps(Figure& other, const Coord& shift = { 0, 0 })
+        {
+            Mask mine, theirs;
+            return GetMask(mine).Overlaps(other.GetMask(theirs), shift);
+        }
+
+
+        // Collides(QPoint, lineType, dist) for a Boxlike figure, from its box alone
+        static int BoxCollides(const Coord& topLeft, const Coord& botRight, const Coord& QPoint, const std::string& lineType, int dist)
+        {
+            // the rows and columns of the box within dist of QPoint
+            int firstRow = std::max(topLeft.ROW, QPoint.ROW - dist), lastRow = std::min(botRight.ROW, QPoint.ROW + dist);
+            int firstCol = std::max(topLeft.COL, QPoint.COL - dist), lastCol = std::min(botRight.COL, QPoint.COL + dist);
+            int res = 0;
+
+            // the first cell of Perimeter() in reach is in the first such row or column
+            if (lineType == "horz")
+                return (firstRow > lastRow) ? 0 : (firstRow > QPoint.ROW) ? Dir::DOWN : Dir::UP;
+
+            if (lineType == "vert")
+                return (firstCol > lastCol) ? 0 : (firstCol > QPoint.COL) ? Dir::RIGHT : Dir::LEFT;
+
+            if (lineType == "all")
+            {
+                if (firstRow <= lastRow && firstRow < QPoint.ROW)
+                    res += Dir::UP;
+                if (firstRow <= lastRow && lastRow > QPoint.ROW)
+                    res += Dir::DOWN;
+                if (firstCol <= lastCol && lastCol > QPoint.COL)
+                    res += Dir::RIGHT;
+                if (firstCol <= lastCol && firstCol < QPoint.COL)
+                    res += Dir::LEFT;
+            }
+
+            return res;
+        }
+
+
+        virtual void ChangeColor(Color fgColor = Palette::NONE, Color bgColor = Palette::NONE, bool optimize = false)
+        {
+            if (fgColor != Palette::NONE)
+                thisState.fgColor = fgColor;
+            if (bgColor != Palette::NONE)
+                thisState.bgColor = bgColor;
+            
+            if (!optimize)
+                Screen::SaveState();
+
+            Draw();
+
+            if (!optimize)
+                Screen::RetrieveState();
+        }
+
+
+        virtual int Collides(const Coord& QPoint, const std::string& lineType, int dist = 1)  //lineType = horz, vert
+        {
+            int res = 0;
+            bool notFound[] = { true, true, true, true };  //UP, DOWN, RIGHT, LEFT
+            Coord topLeft, botRight;
+
+            if (Bounds(topLeft, botRight))
+            {
+                if (Boxlike())
+                    return BoxCollides(topLeft, botRight, QPoint, lineType, dist);
+
+                // any other shape is only walked when its box is near enough
+                bool rowsFar = QPoint.ROW + dist < topLeft.ROW || QPoint.ROW - dist > botRight.ROW;
+                bool colsFar = QPoint.COL + dist < topLeft.COL || QPoint.COL - dist > botRight.COL;
+
+                if ((rowsFar || lineType == "vert") && (colsFar || lineType == "horz"))
+                    return 0;
+            }
+
+            if (lineType == "horz" || lineType == "all")
+            {
+                for (Coord thisPt : Perimeter())
+                {
+                    int diff = thisPt.ROW - QPoint.ROW;
+
+                    if (abs(diff) <= dist)
+                    {
+                        if (lineType == "all")
+                        {
+                            if (diff < 0 && notFound[0])
+                            {
+                                res += Dir::UP;
+                                notFound[0] = false;
+                            }
+                            else if (diff > 0 && notFound[1])
+                            {
+                                res += Dir::DOWN;
+                                notFound[1] = false;
+                            }
+                        }
+                        else
+                            return (diff > 0) ? Dir::DOWN : Dir::UP;
+                    }
+                }
+            }
+            
+            if (lineType == "vert" || lineType == "all")
+            {
+                for (Coord thisPt : Perimeter())
+                {
+                    int diff = thisPt.COL - QPoint.COL;
+
+                    if (abs(diff) <= dist)
+                    {
+                        if (lineType == "all")
+                        {
+                            if (diff > 0 && notFound[2])
+                            {
+                                res += Dir::RIGHT;
+                                notFound[2] = false;
+                            }
+                            else if (diff < 0 && notFound[3])
+                            {
+                                res += Dir::LEFT;
+                                notFound[3] = false;
+                            }
+                        }
+                        else
+                            return (diff > 0) ? Dir::RIGHT : Dir::LEFT;
+                    }
+                }
+            }
+
+            return res;
+        }
+
+
+        virtual int Collides(Figure& other, int dist = 1)
+        {
+            int res = 0;
+            bool notFound[] = { true, true, true, true };  //UP, DOWN, RIGHT, LEFT
+            Coord thisTop, thisBot, otherTop, otherBot;
+
+            // boxes further apart than dist can't have points that are closer
+            if (Bounds(thisTop, thisBot) && other.Bounds(otherTop, otherBot))
+            {
+                if (thisTop.ROW > otherBot.ROW + dist || otherTop.ROW > thisBot.ROW + dist ||
+                    thisTop.COL > otherBot.COL + dist || otherTop.COL > thisBot.COL + dist)
+                    return 0;
+            }
+
+            for (Coord thisPt : Perimeter())
+            {
+                for (Coord otherPt : other.Perimeter())
+                {
+                    if (thisPt.COL == otherPt.COL)
+                    {
+                        int diff = thisPt.ROW - otherPt.ROW;
+
+                        if (abs(diff) <= dist)
+                        {
+                            if (diff < 0 && notFound[0])
+                            {
+                                res += Dir::UP;
+                                notFound[0] = false;
+                            }
+                            else if (diff > 0 && notFound[1])
+                            {
+                                res += Dir::DOWN;
+                                notFound[1] = false;
+                            }
+                        }
+                    }
+
+                    if (thisPt.ROW == otherPt.ROW)
+                    {
+                        int diff = thisPt.COL - otherPt.COL;
+
+                        if (abs(diff) <= dist)
+                        {
+                            if (diff < 0 && notFound[0])
+                            {
+                                res += Dir::UP;
+                                notFound[0] = false;
+                            }
+                            else if (diff > 0 && notFound[1])
+                            {
+                                res += Dir::DOWN;
+                                notFound[1] = false;
+                            }
+                        }
+                    }
+                }
+            }
+
+            return res;
+        }
+};
+
+
+
+class Point : public Figure
+{
+    private:
+        char pointChar;
+
+    public:
+        Point(const Coord& vert = { -1, -1 }, Color fgColor = Palette::NONE, Color bgColor = Palette::NONE, char pointChar = '*') : Figure(vert, fgColor, bgColor)
+        {
+            this->pointChar = pointChar;
+            Draw();
+        }
+
+
+        void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+
+            Screen::SetLayer(thisState.layer);
+            Screen::AtCoord(thisState.coord);
+            Screen::Erase();
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+            
+            if (dontOptimize)
+                Screen::SaveState();
+            
+            Screen::UpdateState(thisState);
+            Screen::Print(pointChar);
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+            if (dontOptimize)
+                Screen::SaveState();
+            
+            Clear(false);
+            thisState.coord = where;
+            Draw(false);
+            
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void ChangeChar(char pointChar, bool optimize = false)
+        {
+            this->pointChar = pointChar;
+
+            if (!optimize)
+                Screen::SaveState();
+
+            Screen::UpdateState(thisState);
+            Screen::Print(pointChar);
+            
+            if (!optimize)
+                Screen::RetrieveState();
+        }
+
+
+        CellRange Perimeter() const override
+        {
+            return CellRange(thisState.coord, 1, 1);
+        }
+
+
+        bool Bounds(Coord& topLeft, Coord& botRight) override
+        {
+            topLeft = botRight = thisState.coord;
+            return true;
+        }
+};
+
+
+
+class HorzLine : public Figure
+{
+    private:
+        std::string pattern;
+        int length;
+
+    public:
+        HorzLine(const std::string& pattern, int length, Coord vertex = { -1, -1 }, Color fgColor = Palette::NONE, Color bgColor = Palette::NONE) : Figure(vertex, fgColor, bgColor)
+        {
+            this->pattern = pattern;
+            this->length = length;
+            Draw();
+        }
+
+
+        void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+
+            Screen::SetLayer(thisState.layer);
+            Screen::AtCoord(thisState.coord);
+            Screen::Erase(length);
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+            
+            int pat_len = pattern.length();
+
+            Screen::UpdateState(thisState);
+
+            for (int i = 0; i < length; i++)
+                Screen::Print(pattern[i % pat_len]);
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+            
+            Clear(false);
+            thisState.coord = where;
+            Draw(false);
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void ChangePattern(const std::string& pattern, bool getCoord = true, bool getBg = false, bool getFg = false)
+        {
+            this->pattern = pattern;
+            Draw(getCoord, getBg, getFg);
+        }
+
+
+        CellRange Perimeter() const override
+        {
+            return CellRange(thisState.coord, 1, length);
+        }
+
+
+        bool Bounds(Coord& topLeft, Coord& botRight) override
+        {
+            topLeft = thisState.coord;
+            botRight = thisState.coord + Coord(0, length - 1);
+            return length > 0;
+        }
+
+
+        ~HorzLine()
+        {
+            Clear();
+        }
+};
+
+
+
+class VertLine : public Figure
+{
+    private:
+        std::string pattern;
+        int length;
+
+    public:
+        VertLine(const std::string& pattern, int length, Coord vertex = { -1, -1 }, Color fgColor = Palette::NONE, Color bgColor = Palette::NONE) : Figure(vertex, fgColor, bgColor)
+        {
+            this->pattern = pattern;
+            this->length = length;
+            Draw();
+        }
+
+
+        void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+            
+            Screen::SetLayer(thisState.layer);
+            Screen::AtCoord(thisState.coord);
+
+            for (int n = length; n--; )
+            {
+                Screen::Erase();
+                Screen::MoveCursor(Dir::DOWN);
+                Screen::MoveCursor(Dir::LEFT);
+            }
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {            
+            int pat_len = pattern.length();
+
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+            
+            
+            Screen::UpdateState(thisState);
+                
+            for (int i = 0; i < length; i++)
+            {
+                Screen::Print(pattern[i % pat_len]);
+                Screen::MoveCursor(Dir::DOWN);
+                Screen::MoveCursor(Dir::LEFT);
+            }
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+
+            Clear(false);
+            thisState.coord = where;
+            Draw(false);
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void ChangePattern(const std::string& pattern, bool getCoord = true, bool getBg = false, bool getFg = false)
+        {
+            this->pattern = pattern;
+            Draw(getCoord, getBg, getFg);
+        }
+
+
+        CellRange Perimeter() const override
+        {
+            return CellRange(thisState.coord, length, 1);
+        }
+
+
+        bool Bounds(Coord& topLeft, Coord& botRight) override
+        {
+            topLeft = thisState.coord;
+            botRight = thisState.coord + Coord(length - 1, 0);
+            return length > 0;
+        }
+
+
+        ~VertLine()
+        {
+            Clear();
+        }
+};
+
+
+
+class Block : public Figure
+{
+    private:
+        std::string pattern;
+
+
+        // prints the cells of the block's area at from that its area at other doesn't cover,
+        // as blanks or in the pattern lined up with thisState.coord
+        void PaintOutside(const Coord& from, const Coord& other, bool blank)
+        {
+            int pat_len = pattern.length();
+
+            for (int n = 0; n < height; n++)
+            {
+                int row = from.ROW + n;
+                int spans[2][2] = { { from.COL, from.COL + width }, { 0, 0 } };   // [first, end)
+
+                // on a row both cover, only what sticks out on the left and on the right
+                if (row >= other.ROW && row < other.ROW + height)
+                {
+                    spans[0][1] = std::min(from.COL + width, other.COL);
+                    spans[1][0] = std::max(from.COL, other.COL + width);
+                    spans[1][1] = from.COL + width;
+                }
+
+                for (auto& span : spans)
+                {
+                    if (span[0] >= span[1])
+                        continue;
+
+                    Screen::AtCoord({ row, span[0] });
+
+                    if (blank)
+                        Screen::Erase(span[1] - span[0]);
+                    else
+                        for (int col = span[0]; col < span[1]; col++)
+                            Screen::Print(pattern[(col - thisState.coord.COL) % pat_len]);
+                }
+            }
+        }
+
+    public:
+        int width, height;
+
+        
+        Block(const std::string& pattern, int width, int height = -1, Coord vertex = { -1, -1 }, Color bgColor = Palette::NONE, Color fgColor = Palette::NONE) : Figure(vertex, fgColor, bgColor)
+        {
+            this->pattern = pattern;
+            this->width = width;
+            this->height = (height == -1) ? width : height;
+            Draw();
+        }
+
+
+        void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+            
+            Screen::SetLayer(thisState.layer);
+            Screen::AtCoord(thisState.coord);
+
+            for (int n = height; n--; )
+            {
+                Screen::Erase(width);
+                Screen::MoveCursor(Dir::DOWN);
+                Screen::MoveCursor(Dir::LEFT, width);
+            }
+
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
+        }
+
+
+        void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        {            
+            int pat_len = pattern.length();
+
+            bool dontOptimize = getCoord || getBg || getFg;
+
+            if (dontOptimize)
+                Screen::SaveState();
+            
+
+            Screen::UpdateState(thisState);
+
+            for (int n = height; n--; )
+            {
+                for (int i = 0; i < width; i++)
+                    Screen::Print(pattern[i % pat_len]);
+
+                Screen::MoveCursor(Dir::DOWN);
+                Screen::MoveCursor(Dir::LEFT, width);
+            }
 
-    public:
-        Point(const Coord& vert = { -1, -1 }, const std::string& fgColor = "", const std::string& bgColor = "", char pointChar = '*') : Figure(vert, fgColor, bgColor)
-        {
-            this->pointChar = pointChar;
-            Draw();
+            if (dontOptimize)
+                Screen::RetrieveState(getCoord, getBg, getFg);
         }
 
 
-        void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        // only the cells the block leaves are cleared and only the ones it comes to are drawn,
+        // unless it moves sideways by other than whole patterns, which changes every cell
+        void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) override
         {
             bool dontOptimize = getCoord || getBg || getFg;
+            Coord from = thisState.coord;
 
             if (dontOptimize)
                 Screen::SaveState();
 
-            Screen::SetColor("", Screen::SCREEN_BG);
-            Screen::AtCoord(thisState.coord);
-            outBuff << " ";
+            Screen::SetLayer(thisState.layer);
+            PaintOutside(from, where, true);
+            thisState.coord = where;
+
+            if ((where.COL - from.COL) % (int) pattern.length() != 0)
+                Draw(false);
+            else
+            {
+                Screen::UpdateState(thisState);
+                PaintOutside(where, from, false);
+            }
 
             if (dontOptimize)
                 Screen::RetrieveState(getCoord, getBg, getFg);
         }
 
 
-        void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        // RETURNS FALSE IF CAN'T EXPAND/CONTRACT FURTHER
+        bool Reframe(const Coord& delta, bool getCoord = true, bool getBg = false, bool getFg = false)
         {
-            bool dontOptimize = getCoord || getBg || getFg;
-            
-            if (dontOptimize)
+            int oldWidth = width;
+            height += delta.ROW;
+            width  += delta.COL;
+
+            if (height <= 0 || width <= 0 || height > Screen::HEIGHT || width > Screen::WIDTH)
+                return false;
+
+            bool notOptimize = !(getCoord || getBg || getFg);
+
+            if (notOptimize)
                 Screen::SaveState();
             
-            Screen::UpdateState(thisState);
-            outBuff << pointChar;
+            int pat_len = pattern.length();
+            int minWidth  = std::min(width,  width  - delta.COL);
+            int minHeight = std::min(height, height - delta.ROW);
 
-            if (dontOptimize)
+            Screen::SetLayer(thisState.layer);
+
+
+            if (delta.COL > 0)
+            {
+                Screen::SetColor(thisState.fgColor, thisState.bgColor);
+
+                for (int n = 0; n < minHeight; n++ )
+                {
+                    Screen::AtCoord({ thisState.coord.ROW + n, thisState.coord.COL + minWidth });
+                    for (int i = 0; i < delta.COL; i++)
+                        Screen::Print(pattern[i % pat_len]);
+                }
+            }
+            else
+            {
+                for (int n = 0; n < minHeight; n++ )
+                {
+                    Screen::AtCoord({ thisState.coord.ROW + n, thisState.coord.COL + minWidth });
+                    Screen::Erase(-delta.COL);
+                }
+            }
+    
+            if (delta.ROW > 0)
+            {
+                Screen::SetColor(thisState.fgColor, thisState.bgColor);
+
+                for (int n = minHeight; n < height; n++)
+                {
+                    Screen::AtCoord({ thisState.coord.ROW + n, thisState.coord.COL });
+                    for (int i = 0; i < width; i++)
+                        Screen::Print(pattern[i % pat_len]);
+                }
+            }
+            else
+            {
+                for (int n = 0; n < -delta.ROW; n++)
+                {
+                    Screen::AtCoord({ thisState.coord.ROW + minHeight + n, thisState.coord.COL });
+                    Screen::Erase(oldWidth);
+                }
+            }
+
+            if (notOptimize)
                 Screen::RetrieveState(getCoord, getBg, getFg);
+
+            return true;
         }
 
 
-        void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        void ChangePattern(const std::string& pattern, bool getCoord = true, bool getBg = false, bool getFg = false)
         {
-            bool dontOptimize = getCoord || getBg || getFg;
-            if (dontOptimize)
-                Screen::SaveState();
-            
-            Clear(false);
-            thisState.coord = where;
-            Draw(false);
-            
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+            this->pattern = pattern;
+            Draw(getCoord, getBg, getFg);
         }
 
 
-        void ChangeChar(char pointChar, bool optimize = false)
+        CellRange Perimeter() const override
         {
-            this->pointChar = pointChar;
+            return CellRange(thisState.coord, height, width, true);
+        }
 
-            if (!optimize)
-                Screen::SaveState();
 
-            Screen::UpdateState(thisState);
-            outBuff << pointChar;
-            
-            if (!optimize)
-                Screen::RetrieveState();
+        CellRange Filled() const override
+        {
+            return CellRange(thisState.coord, height, width);
         }
 
 
-        Coord Next(bool reset = false) override
+        // a block draws its whole area, not just its perimeter
+        void Stamp(Mask& mask) override
         {
-            if (reset || iterEnd)
-            {
-                iterEnd = false;
-                return Coord(-1, -1);
-            }
+            for (int n = 0; n < height; n++)
+                mask.SetRun(thisState.coord + Coord(n, 0), width);
+        }
+
+
+        const Mask& GetMask(Mask& scratch) override
+        {
+            scratch = Mask(thisState.coord, std::max(height, 0), std::max(width, 0));
+            Stamp(scratch);
+            return scratch;
+        }
+
+
+        // the perimeter of a 1x1 block has no cells at all
+        bool Bounds(Coord& topLeft, Coord& botRight) override
+        {
+            topLeft = thisState.coord;
+            botRight = thisState.coord + Coord(height - 1, width - 1);
+            return width > 0 && height > 0 && width + height > 2;
+        }
+
 
-            iterEnd = true;
-            return thisState.coord;
+        ~Block()
+        {
+            Clear();
         }
 };
 
 
 
-class HorzLine : public Figure
+class Group : public Figure
 {
     private:
-        std::string pattern;
-        int length, iterIndex = 0;
+        std::vector<Figure*> elms;
+        int anchor = -1;
 
+        // the union of the elements' bounds and their mask, worked out once and moved along by MoveBy
+        Coord boxTop, boxBot;
+        bool boxKnown = false, boxEmpty = true;
+        Mask mask;
+        bool maskKnown = false;
+    
     public:
-        HorzLine(const std::string& pattern, int length, Coord vertex = { -1, -1 }, const std::string& fgColor = "", const std::string& bgColor = "") : Figure(vertex, fgColor, bgColor)
+        Group(std::vector<Figure*> vec, int anchor = -1)
         {
-            this->pattern = pattern;
-            this->length = length;
-            Draw();
+            elms = vec;
+            this->anchor = anchor;
+        }
+
+
+        Group(Figure *arr[], int length, int anchor = -1)
+        {
+            for (int i = 0; i < length; i++)
+                elms.push_back(arr[i]);
+            
+            this->anchor = anchor;
+        }
+
+
+        std::vector<Figure*> GetElements()
+        {
+            return elms;
         }
 
 
@@ -813,485 +2799,626 @@ class HorzLine : public Figure
             if (dontOptimize)
                 Screen::SaveState();
 
-            Screen::SetColor("", Screen::SCREEN_BG);
-            Screen::AtCoord(thisState.coord);
-            outBuff << std::string(length, ' ');
+            for (Figure* elm : elms)
+                elm->Clear(false);
 
             if (dontOptimize)
                 Screen::RetrieveState(getCoord, getBg, getFg);
         }
 
 
-        void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        void MoveBy(const Coord& diff, bool getCoord = true, bool getBg = false, bool getFg = false) override
         {
             bool dontOptimize = getCoord || getBg || getFg;
 
             if (dontOptimize)
                 Screen::SaveState();
-            
-            int pat_len = pattern.length();
 
-            Screen::UpdateState(thisState);
+            // only the cells the group leaves are cleared, the ones it still covers get drawn over
+            Mask scratch;
+            const Mask& footprint = GetMask(scratch);
 
-            for (int i = 0; i < length; i++)
-                outBuff << pattern[i % pat_len];
+            Screen::SetLayer(thisState.layer);
+
+            for (Coord cell : Filled())
+            {
+                if (!footprint.Test(cell - diff))
+                {
+                    Screen::AtCoord(cell);
+                    Screen::Erase();
+                }
+            }
+
+            for (Figure* elm : elms)
+            {
+                elm->thisState.coord += diff;
+                elm->Draw(false);
+            }
+
+            boxTop += diff;
+            boxBot += diff;
+            mask.topLeft += diff;
 
             if (dontOptimize)
                 Screen::RetrieveState(getCoord, getBg, getFg);
         }
 
 
-        void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        void MoveTo(const Coord& dest, bool getCoord = true, bool getBg = false, bool getFg = false) override
         {
-            bool dontOptimize = getCoord || getBg || getFg;
+            MoveBy(dest - elms[anchor]->thisState.coord, getCoord, getBg, getFg);
+        }
 
-            if (dontOptimize)
+
+        void ChangeColor(Color fgColor = Palette::NONE, Color bgColor = Palette::NONE, bool optimize = false) override
+        {
+            if (!optimize)
                 Screen::SaveState();
-            
-            Clear(false);
-            thisState.coord = where;
-            Draw(false);
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+            for (Figure* elm : elms)
+                elm->ChangeColor(fgColor, bgColor, false);
+
+            if (!optimize)
+                Screen::RetrieveState();
         }
 
 
-        void ChangePattern(const std::string& pattern, bool getCoord = true, bool getBg = false, bool getFg = false)
+        bool Bounds(Coord& topLeft, Coord& botRight) override
         {
-            this->pattern = pattern;
-            Draw(getCoord, getBg, getFg);
+            if (!boxKnown)
+            {
+                boxKnown = true;
+
+                for (Figure* elm : elms)
+                {
+                    Coord top, bot;
+
+                    if (!elm->Bounds(top, bot))
+                        continue;
+
+                    if (boxEmpty)
+                    {
+                        boxTop = top;
+                        boxBot = bot;
+                        boxEmpty = false;
+                    }
+
+                    boxTop = Coord(std::min(boxTop.ROW, top.ROW), std::min(boxTop.COL, top.COL));
+                    boxBot = Coord(std::max(boxBot.ROW, bot.ROW), std::max(boxBot.COL, bot.COL));
+                }
+            }
+
+            topLeft = boxTop;
+            botRight = boxBot;
+            return !boxEmpty;
+        }
+
+
+        bool Boxlike() override
+        {
+            return false;
         }
 
 
-        Coord Next(bool reset = false) override
+        void Stamp(Mask& mask) override
         {
-            if (reset || iterIndex == length)
+            for (Figure* elm : elms)
+                elm->Stamp(mask);
+        }
+
+
+        const Mask& GetMask(Mask& scratch) override
+        {
+            if (!maskKnown)
             {
-                iterIndex = 0;
-                return Coord(-1, -1);
+                maskKnown = true;
+                mask = Figure::GetMask(scratch);
             }
 
-            return thisState.coord + Coord(0, iterIndex++);
+            return mask;
         }
 
 
-        ~HorzLine()
+        CellRange Perimeter() const override
         {
-            Clear();
+            return CellRange(elms, false);
         }
-};
 
 
+        CellRange Filled() const override
+        {
+            return CellRange(elms, true);
+        }
+};
 
-class VertLine : public Figure
+
+// A group of single-glyph cells kept as arrays rather than as Points, for figures
+// built up a cell at a time. Moving or recoloring it is a loop over plain
+// ints and ids, and drawing puts cells on its layer directly: no virtual call, no
+// state save or restore per cell. The cursor and colors are left as they were, so
+// the getCoord, getBg and getFg flags of Clear, Draw and the moves have nothing to
+// bring back and are ignored, as is ChangeColor's optimize: it always draws.
+class PackedGroup : public Figure
 {
     private:
-        std::string pattern;
-        int length, iterIndex = 0;
+        std::vector<int> rows, cols;
+        std::vector<char> glyphs;
+        std::vector<ColorId> fgColors, bgColors;
 
-    public:
-        VertLine(const std::string& pattern, int length, Coord vertex = { -1, -1 }, const std::string& fgColor = "", const std::string& bgColor = "") : Figure(vertex, fgColor, bgColor)
-        {
-            this->pattern = pattern;
-            this->length = length;
-            Draw();
-        }
+        // the box is kept up to date by Add and Translate, the mask is worked out once and moved along
+        Coord boxTop, boxBot;
+        Mask mask;
+        bool maskKnown = false;
 
 
-        void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        // puts cells [first, last) on the group's layer, or takes them off it if blank,
+        // skipping any that keep moved by shift would still cover
+        void Put(size_t first, size_t last, bool blank, const Mask *keep = nullptr, const Coord& shift = { 0, 0 })
         {
-            bool dontOptimize = getCoord || getBg || getFg;
-
-            if (dontOptimize)
-                Screen::SaveState();
-            
-            Screen::SetColor("", Screen::SCREEN_BG);
-            Screen::AtCoord(thisState.coord);
+            int top = Screen::HEIGHT + 1, bot = 0, put = 0;
 
-            for (int n = length; n--; )
+            for (size_t i = first; i < last; i++)
             {
-                outBuff << " ";
-                Screen::MoveCursor(Dir::DOWN);
-                Screen::MoveCursor(Dir::LEFT);
+                int row = rows[i], col = cols[i];
+
+                if (row < 1 || col < 1 || row > Screen::HEIGHT || col > Screen::WIDTH)
+                    continue;
+
+                if (keep && keep->Test(Coord(row, col) - shift))
+                    continue;
+
+                int at = (row - 1) * Screen::WIDTH + col - 1;
+
+                if (blank)
+                    Screen::EraseCell(at, thisState.layer);
+                else
+                    Screen::PutCell(at, Cell(glyphs[i], fgColors[i], bgColors[i], thisState.style), thisState.layer);
+                top = std::min(top, row);
+                bot = std::max(bot, row);
+                put++;
             }
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+            if (put)
+            {
+                Screen::frame.printed += put;
+                Screen::dirtyTop = std::min(Screen::dirtyTop, top);
+                Screen::dirtyBot = std::max(Screen::dirtyBot, bot);
+            }
         }
 
 
-        void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) override
-        {            
-            int pat_len = pattern.length();
+    public:
+        PackedGroup(Color fgColor = Palette::NONE, Color bgColor = Palette::NONE) : Figure({ 1, 1 }, fgColor, bgColor) { }
 
-            bool dontOptimize = getCoord || getBg || getFg;
 
-            if (dontOptimize)
-                Screen::SaveState();
-            
-            
-            Screen::UpdateState(thisState);
-                
-            for (int i = 0; i < length; i++)
+        // a cell in the group's colors, unless given its own; drawn straight away like a Point
+        void Add(const Coord& where, char glyph = '*', Color fgColor = Palette::NONE, Color bgColor = Palette::NONE)
+        {
+            if (rows.empty())
             {
-                outBuff << pattern[i % pat_len];
-                Screen::MoveCursor(Dir::DOWN);
-                Screen::MoveCursor(Dir::LEFT);
+                thisState.coord = boxTop = boxBot = where;
             }
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+            rows.push_back(where.ROW);
+            cols.push_back(where.COL);
+            glyphs.push_back(glyph);
+            fgColors.push_back((fgColor == Palette::NONE) ? thisState.fgColor : fgColor.id);
+            bgColors.push_back((bgColor == Palette::NONE) ? thisState.bgColor : bgColor.id);
+
+            boxTop = Coord(std::min(boxTop.ROW, where.ROW), std::min(boxTop.COL, where.COL));
+            boxBot = Coord(std::max(boxBot.ROW, where.ROW), std::max(boxBot.COL, where.COL));
+            maskKnown = false;
+
+            Put(rows.size() - 1, rows.size(), false);
         }
 
 
-        void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        int Size() const
         {
-            bool dontOptimize = getCoord || getBg || getFg;
-
-            if (dontOptimize)
-                Screen::SaveState();
+            return rows.size();
+        }
 
-            Clear(false);
-            thisState.coord = where;
-            Draw(false);
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+        Coord At(int index) const
+        {
+            return Coord(rows[index], cols[index]);
         }
 
 
-        void ChangePattern(const std::string& pattern, bool getCoord = true, bool getBg = false, bool getFg = false)
+        // moves every cell without drawing anything
+        void Translate(const Coord& diff)
         {
-            this->pattern = pattern;
-            Draw(getCoord, getBg, getFg);
+            int *row = rows.data(), *col = cols.data();
+            int count = rows.size();
+
+            for (int i = 0; i < count; i++)
+                row[i] += diff.ROW;
+
+            for (int i = 0; i < count; i++)
+                col[i] += diff.COL;
+
+            thisState.coord += diff;
+            boxTop += diff;
+            boxBot += diff;
+            mask.topLeft += diff;
         }
 
 
-        Coord Next(bool reset = false) override
+        // gives every cell the colors, NONE keeping what it has, without drawing anything
+        void Recolor(Color fgColor = Palette::NONE, Color bgColor = Palette::NONE)
         {
-            if (reset || iterIndex == length)
+            if (fgColor != Palette::NONE)
             {
-                iterIndex = 0;
-                return Coord(-1, -1);
+                thisState.fgColor = fgColor;
+                std::fill(fgColors.begin(), fgColors.end(), fgColor.id);
             }
 
-            return thisState.coord + Coord(iterIndex++, 0);
+            if (bgColor != Palette::NONE)
+            {
+                thisState.bgColor = bgColor;
+                std::fill(bgColors.begin(), bgColors.end(), bgColor.id);
+            }
         }
 
 
-        ~VertLine()
+        void Clear([[maybe_unused]] bool getCoord = true, [[maybe_unused]] bool getBg = false, [[maybe_unused]] bool getFg = false) override
         {
-            Clear();
+            Put(0, rows.size(), true);
         }
-};
-
 
 
-class Block : public Figure
-{
-    private:
-        std::string pattern;
-        int iterIndex = 0;
+        void Draw([[maybe_unused]] bool getCoord = true, [[maybe_unused]] bool getBg = false, [[maybe_unused]] bool getFg = false) override
+        {
+            Put(0, rows.size(), false);
+        }
 
-    public:
-        int width, height;
 
-        
-        Block(const std::string& pattern, int width, int height = -1, Coord vertex = { -1, -1 }, const std::string& bgColor = "", const std::string& fgColor = "") : Figure(vertex, fgColor, bgColor)
+        // clears only the cells the group leaves, the ones it still covers get drawn over
+        void MoveBy(const Coord& diff, [[maybe_unused]] bool getCoord = true, [[maybe_unused]] bool getBg = false, [[maybe_unused]] bool getFg = false) override
         {
-            this->pattern = pattern;
-            this->width = width;
-            this->height = (height == -1) ? width : height;
+            Mask scratch;
+
+            Put(0, rows.size(), true, &GetMask(scratch), diff);
+            Translate(diff);
             Draw();
         }
 
 
-        void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        // puts the first cell at dest
+        void MoveTo(const Coord& dest, [[maybe_unused]] bool getCoord = true, [[maybe_unused]] bool getBg = false, [[maybe_unused]] bool getFg = false) override
         {
-            bool dontOptimize = getCoord || getBg || getFg;
-
-            if (dontOptimize)
-                Screen::SaveState();
-            
-            Screen::SetColor("", Screen::SCREEN_BG);
-            Screen::AtCoord(thisState.coord);
+            MoveBy(dest - thisState.coord);
+        }
 
-            for (int n = height; n--; )
-            {
-                outBuff << std::string(width, ' ');
-                Screen::MoveCursor(Dir::DOWN);
-                Screen::MoveCursor(Dir::LEFT, width);
-            }
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+        void ChangeColor(Color fgColor = Palette::NONE, Color bgColor = Palette::NONE, [[maybe_unused]] bool optimize = false) override
+        {
+            Recolor(fgColor, bgColor);
+            Draw();
         }
 
 
-        void Draw(bool getCoord = true, bool getBg = false, bool getFg = false) override
-        {            
-            int pat_len = pattern.length();
+        bool Bounds(Coord& topLeft, Coord& botRight) override
+        {
+            topLeft = boxTop;
+            botRight = boxBot;
+            return !rows.empty();
+        }
 
-            bool dontOptimize = getCoord || getBg || getFg;
 
-            if (dontOptimize)
-                Screen::SaveState();
-            
+        bool Boxlike() override
+        {
+            return false;
+        }
 
-            Screen::UpdateState(thisState);
 
-            for (int n = height; n--; )
+        const Mask& GetMask(Mask& scratch) override
+        {
+            if (!maskKnown)
             {
-                for (int i = 0; i < width; i++)
-                    outBuff << pattern[i % pat_len];
-
-                Screen::MoveCursor(Dir::DOWN);
-                Screen::MoveCursor(Dir::LEFT, width);
+                maskKnown = true;
+                mask = Figure::GetMask(scratch);
             }
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+            return mask;
         }
 
 
-        void MoveTo(const Coord& where, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        CellRange Perimeter() const override
         {
-            bool dontOptimize = getCoord || getBg || getFg;
+            return CellRange(rows.data(), cols.data(), rows.size());
+        }
+};
 
-            if (dontOptimize)
-                Screen::SaveState();
 
-            Clear(false);
-            thisState.coord = where;
-            Draw(false);
+// A picture of glyphs in one pair of colors, encoded once into rows of finished
+// cells and re-encoded only when recolored. Drawing copies each row onto its layer
+// and, with nothing drawn above, straight into the back buffer, so a fish or a ball
+// costs a copy per row rather than a state change per cell. The clear glyph marks holes in the picture; '\0' has none.
+// Like a PackedGroup it leaves the cursor and colors alone, so the getCoord, getBg and getFg
+// flags are ignored, and so is ChangeColor's optimize.
+class Sprite : public Figure
+{
+    private:
+        // a row of cells with no hole in it, offsets from the top left corner
+        class Run
+        {
+            public:
+                int row, col;
+                int first, length;   // its cells in cells
+        };
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
-        }
+        std::vector<std::string> picture;
+        char clear;
 
+        std::vector<Cell> cells;
+        std::vector<Run> runs;
+        std::vector<int> rows, cols;               // of every cell, row by row
+        std::vector<int> outlineRows, outlineCols; // of the cells next to a hole or the edge
+        int height = 0, width = 0;
+        bool solid = true;                         // no holes, the picture fills its box
 
-        // RETURNS FALSE IF CAN'T EXPAND/CONTRACT FURTHER
-        bool Reframe(const Coord& delta, bool getCoord = true, bool getBg = false, bool getFg = false)
-        {
-            int oldWidth = width;
-            height += delta.ROW;
-            width  += delta.COL;
+        Mask mask;
+        bool maskKnown = false;
 
-            if (height <= 0 || width <= 0 || height > Screen::HEIGHT || width > Screen::WIDTH)
-                return false;
 
-            bool notOptimize = !(getCoord || getBg || getFg);
+        bool Opaque(int row, int col) const
+        {
+            return row >= 0 && row < height && col >= 0 && col < (int) picture[row].size() && picture[row][col] != clear;
+        }
 
-            if (notOptimize)
-                Screen::SaveState();
-            
-            int pat_len = pattern.length();
-            int minWidth  = std::min(width,  width  - delta.COL);
-            int minHeight = std::min(height, height - delta.ROW);
 
+        // builds the cells and runs from the picture in the current colors
+        void Encode()
+        {
+            cells.clear();
+            runs.clear();
 
-            if (delta.COL > 0)
+            for (int row = 0; row < height; row++)
             {
-                Screen::SetColor(thisState.fgColor, thisState.bgColor);
-
-                for (int n = 0; n < minHeight; n++ )
+                for (int col = 0; col < (int) picture[row].size(); )
                 {
-                    Screen::AtCoord({ thisState.coord.ROW + n, thisState.coord.COL + minWidth });
-                    for (int i = 0; i < delta.COL; i++)
-                        outBuff << pattern[i % pat_len];
-                }
-            }
-            else
-            {
-                Screen::SetColor("", Screen::SCREEN_BG);
+                    if (!Opaque(row, col))
+                    {
+                        col++;
+                        continue;
+                    }
 
-                for (int n = 0; n < minHeight; n++ )
-                {
-                    Screen::AtCoord({ thisState.coord.ROW + n, thisState.coord.COL + minWidth });
-                    outBuff << std::string(-delta.COL, ' ');
-                }
-            }
-    
-            if (delta.ROW > 0)
-            {
-                Screen::SetColor(thisState.fgColor, thisState.bgColor);
+                    Run run = { row, col, (int) cells.size(), 0 };
 
-                for (int n = minHeight; n < height; n++)
-                {
-                    Screen::AtCoord({ thisState.coord.ROW + n, thisState.coord.COL });
-                    for (int i = 0; i < width; i++)
-                        outBuff << pattern[i % pat_len];
+                    for ( ; Opaque(row, col); col++, run.length++)
+                        cells.emplace_back(picture[row][col], thisState.fgColor, thisState.bgColor, thisState.style);
+
+                    runs.push_back(run);
                 }
             }
-            else
+        }
+
+
+        // works out where the cells are; the picture doesn't change, so only once
+        void Layout()
+        {
+            for (int row = 0; row < height; row++)
             {
-                Screen::SetColor("", Screen::SCREEN_BG);
+                width = std::max(width, (int) picture[row].size());
 
-                for (int n = 0; n < -delta.ROW; n++)
+                for (int col = 0; col < (int) picture[row].size(); col++)
                 {
-                    Screen::AtCoord({ thisState.coord.ROW + minHeight + n, thisState.coord.COL });
-                    outBuff << std::string(oldWidth, ' ');
+                    if (!Opaque(row, col))
+                        continue;
+
+                    rows.push_back(row);
+                    cols.push_back(col);
+
+                    if (!Opaque(row - 1, col) || !Opaque(row + 1, col) || !Opaque(row, col - 1) || !Opaque(row, col + 1))
+                    {
+                        outlineRows.push_back(row);
+                        outlineCols.push_back(col);
+                    }
                 }
             }
 
-            if (notOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
-
-            return true;
+            solid = !rows.empty() && (int) rows.size() == height * width;
         }
 
 
-        void ChangePattern(const std::string& pattern, bool getCoord = true, bool getBg = false, bool getFg = false)
+        // copies every run onto the sprite's layer, clipped to the screen
+        void Blit()
         {
-            this->pattern = pattern;
-            Draw(getCoord, getBg, getFg);
-        }
+            int top = Screen::HEIGHT + 1, bot = 0, put = 0;
 
+            for (const Run& run : runs)
+            {
+                int row = thisState.coord.ROW + run.row, col = thisState.coord.COL + run.col;
+                int first = std::max(1 - col, 0), last = std::min(Screen::WIDTH + 1 - col, run.length);
 
-        Coord Next(bool reset = false) override
-        {
-            if (reset || iterIndex == 2 * (width + height) - 4)
+                if (row < 1 || row > Screen::HEIGHT || first >= last)
+                    continue;
+
+                Screen::PutCells((row - 1) * Screen::WIDTH + col - 1 + first, &cells[run.first + first], last - first, thisState.layer);
+                top = std::min(top, row);
+                bot = std::max(bot, row);
+                put += last - first;
+            }
+
+            if (put)
             {
-                iterIndex = 0;
-                return Coord(-1, -1);
+                Screen::frame.printed += put;
+                Screen::dirtyTop = std::min(Screen::dirtyTop, top);
+                Screen::dirtyBot = std::max(Screen::dirtyBot, bot);
             }
-            
-            Coord offset;
+        }
+
+
+        // takes the cells off the sprite's layer, skipping any that keep moved by shift would still cover
+        void Erase(const Mask *keep = nullptr, const Coord& shift = { 0, 0 })
+        {
+            int top = Screen::HEIGHT + 1, bot = 0, put = 0;
 
-            if (iterIndex < width)
-                offset = { 0, iterIndex };
+            for (const Run& run : runs)
+            {
+                int row = thisState.coord.ROW + run.row, col = thisState.coord.COL + run.col;
+                int first = std::max(1 - col, 0), last = std::min(Screen::WIDTH + 1 - col, run.length);
 
-            else if (iterIndex < width + height - 1)
-                offset = { iterIndex - width + 1, width - 1 };
+                if (row < 1 || row > Screen::HEIGHT || first >= last)
+                    continue;
 
-            else if (iterIndex < 2 * (width - 1) + height)
-                offset = { height - 1, 2 * width + height - iterIndex - 3 };
+                int at = (row - 1) * Screen::WIDTH + col - 1;
 
-            else
-                offset = { 2 * (width + height) - iterIndex - 4, 0 };
+                for (int i = first; i < last; i++)
+                {
+                    if (keep && keep->Test(Coord(row, col + i) - shift))
+                        continue;
 
+                    Screen::EraseCell(at + i, thisState.layer);
+                    top = std::min(top, row);
+                    bot = std::max(bot, row);
+                    put++;
+                }
+            }
 
-            iterIndex++;
-            return Coord(thisState.coord + offset);
+            if (put)
+            {
+                Screen::frame.printed += put;
+                Screen::dirtyTop = std::min(Screen::dirtyTop, top);
+                Screen::dirtyBot = std::max(Screen::dirtyBot, bot);
+            }
         }
 
 
-        ~Block()
+    public:
+        // picture is a list of rows with topLeft at the first glyph of the first; drawn straight away
+        Sprite(const std::vector<std::string>& picture, const Coord& topLeft, Color fgColor = Palette::NONE,
+               Color bgColor = Palette::NONE, char clear = ' ') : Figure(topLeft, fgColor, bgColor)
         {
-            Clear();
-        }
-};
+            this->picture = picture;
+            this->clear = clear;
+            height = picture.size();
 
+            Layout();
+            Encode();
+            Blit();
+        }
 
 
-class Group : public Figure
-{
-    private:
-        std::vector<Figure*> elms;
-        int anchor = -1, iterIndex = 0;
-    
-    public:
-        Group(std::vector<Figure*> vec, int anchor = -1)
+        int Height() const
         {
-            elms = vec;
-            this->anchor = anchor;
+            return height;
         }
 
 
-        Group(Figure *arr[], int length, int anchor = -1)
+        int Width() const
         {
-            for (int i = 0; i < length; i++)
-                elms.push_back(arr[i]);
-            
-            this->anchor = anchor;
+            return width;
         }
 
 
-        std::vector<Figure*> GetElements()
+        void Clear([[maybe_unused]] bool getCoord = true, [[maybe_unused]] bool getBg = false, [[maybe_unused]] bool getFg = false) override
         {
-            return elms;
+            Erase();
         }
 
 
-        void Clear(bool getCoord = true, bool getBg = false, bool getFg = false) override
+        void Draw([[maybe_unused]] bool getCoord = true, [[maybe_unused]] bool getBg = false, [[maybe_unused]] bool getFg = false) override
         {
-            bool dontOptimize = getCoord || getBg || getFg;
+            Blit();
+        }
 
-            if (dontOptimize)
-                Screen::SaveState();
 
-            for (Figure* elm : elms)
-                elm->Clear(false);
+        // clears only the cells the sprite leaves, the ones it still covers get drawn over
+        void MoveBy(const Coord& diff, [[maybe_unused]] bool getCoord = true, [[maybe_unused]] bool getBg = false, [[maybe_unused]] bool getFg = false) override
+        {
+            Mask scratch;
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+            Erase(&GetMask(scratch), diff);
+            thisState.coord += diff;
+            mask.topLeft += diff;
+            Blit();
         }
 
 
-        void MoveBy(const Coord& diff, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        // puts the top left corner at dest
+        void MoveTo(const Coord& dest, [[maybe_unused]] bool getCoord = true, [[maybe_unused]] bool getBg = false, [[maybe_unused]] bool getFg = false) override
         {
-            bool dontOptimize = getCoord || getBg || getFg;
+            MoveBy(dest - thisState.coord);
+        }
 
-            if (dontOptimize)
-                Screen::SaveState();
 
-            Clear(false);
+        // NONE keeps a color as it is; the cells are encoded again and drawn
+        void ChangeColor(Color fgColor = Palette::NONE, Color bgColor = Palette::NONE, [[maybe_unused]] bool optimize = false) override
+        {
+            if (fgColor != Palette::NONE)
+                thisState.fgColor = fgColor;
 
-            for (Figure* elm : elms)
-            {
-                elm->thisState.coord += diff;
-                elm->Draw(false);
-            }
+            if (bgColor != Palette::NONE)
+                thisState.bgColor = bgColor;
 
-            if (dontOptimize)
-                Screen::RetrieveState(getCoord, getBg, getFg);
+            Encode();
+            Blit();
         }
 
 
-        void MoveTo(const Coord& dest, bool getCoord = true, bool getBg = false, bool getFg = false) override
+        bool Bounds(Coord& topLeft, Coord& botRight) override
         {
-            MoveBy(dest - elms[anchor]->thisState.coord, getCoord, getBg, getFg);
+            topLeft = thisState.coord;
+            botRight = thisState.coord + Coord(height - 1, width - 1);
+            return !rows.empty();
         }
 
 
-        void ChangeColor(const std::string& fgColor = "", const std::string& bgColor = "", bool optimize = false) override
+        // a solid picture is walked like a block: its border, top row first
+        bool Boxlike() override
         {
-            if (!optimize)
-                Screen::SaveState();
+            return solid;
+        }
 
-            for (Figure* elm : elms)
-                elm->ChangeColor(fgColor, bgColor, false);
 
-            if (!optimize)
-                Screen::RetrieveState();
+        void Stamp(Mask& mask) override
+        {
+            for (const Run& run : runs)
+                mask.SetRun(thisState.coord + Coord(run.row, run.col), run.length);
         }
 
 
-        Coord Next(bool reset = false) override
+        const Mask& GetMask(Mask& scratch) override
         {
-            while (true)
+            if (!maskKnown)
             {
-                if (reset || iterIndex == elms.size())
-                {
-                    if (iterIndex)
-                    {
-                        elms[reset ? iterIndex : iterIndex - 1]->Next(true);
-                        iterIndex = 0;
-                    }
+                maskKnown = true;
+                mask = Figure::GetMask(scratch);
+            }
 
-                    return Coord(-1, -1);
-                }
+            return mask;
+        }
 
-                Coord ptNow = elms[iterIndex]->Next();
 
-                if (!ptNow.isValid())
-                {
-                    iterIndex++;
-                    continue;
-                }
+        // the cells next to a hole or the edge of the picture, row by row
+        CellRange Perimeter() const override
+        {
+            return CellRange(outlineRows.data(), outlineCols.data(), outlineRows.size(), thisState.coord);
+        }
 
-                return ptNow;
-            }
+
+        CellRange Filled() const override
+        {
+            return CellRange(rows.data(), cols.data(), rows.size(), thisState.coord);
         }
 };
+
+
+inline void CellRange::Iterator::Settle()
+{
+    while (index >= piece.Count())
+    {
+        if (++part >= (int) range->parts->size())
+        {
+            part = range->parts->size();
+            index = 0;
+            return;
+        }
+
+        Figure *elm = (*range->parts)[part];
+        piece = range->filledParts ? elm->Filled() : elm->Perimeter();
+        index = 0;
+    }
+}